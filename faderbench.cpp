@@ -0,0 +1,289 @@
+/* ------------------------------------------------------------------------------
+   Fader law test and benchmark for the x-touch library.
+   Checks the accuracy of the position, dB and gain conversions for each
+   taper against exact calculations, then times them one at a time and
+   in batches against the pow()/log10() code they replace.
+   -----------------------------------------------------------------------------*/
+
+/*
+MIT License
+
+Copyright (c) 2020 Martin Whitaker
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+/* Usage:
+     x-touch-faderbench [-n batchsize]
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <math.h>
+#include <time.h>
+
+#include "x-touch-fader.h"
+
+#define SAMPLES 65536
+
+static const char *TaperNames[] = { "console", "db", "gain" };
+
+// Works out the position for a dB value the slow way, by searching every position
+int ExactPosition(XTouchFaderLaw *law, float db) {
+    int position;
+    int best=0;
+    float error;
+    float besterror=1e30f;
+    if (db<law->MinDb()) return 0;
+    for(position=1;position<=XT_FADER_MAX;position++) {
+        error=fabsf(law->PositionToDb(position)-db);
+        if (error<besterror) {
+            besterror=error;
+            best=position;
+        }
+    }
+    return best;
+}
+
+// Returns 1 if every check passed
+int Accuracy(XTouchFaderLaw *law) {
+    static int positions[XT_FADER_MAX+1];
+    static float db[XT_FADER_MAX+1];
+    static float gains[XT_FADER_MAX+1];
+    static int batch[XT_FADER_MAX+1];
+    int position;
+    int i;
+    int mismatches=0;
+    int roundtrip=0;
+    int maxerror=0;
+    int error;
+    float d;
+    float exact;
+    double maxdb=0;
+    double maxgain=0;
+
+    // Every position should get back to itself through dB and through gain
+    for(position=0;position<=XT_FADER_MAX;position++) {
+        positions[position]=position;
+        if (law->DbToPosition(law->PositionToDb(position))!=position) roundtrip++;
+        if (law->GainToPosition(law->PositionToGain(position))!=position) roundtrip++;
+    }
+    law->PositionsToDb(positions,db,XT_FADER_MAX+1);
+    law->DbToPositions(db,batch,XT_FADER_MAX+1);
+    for(position=0;position<=XT_FADER_MAX;position++) {
+        if (batch[position]!=position) roundtrip++;
+    }
+    law->PositionsToGain(positions,gains,XT_FADER_MAX+1);
+    law->GainToPositions(gains,batch,XT_FADER_MAX+1);
+    for(position=0;position<=XT_FADER_MAX;position++) {
+        if (batch[position]!=position) roundtrip++;
+    }
+
+    // dB values in between positions should go to the nearest one
+    for(i=0;i<2000;i++) {
+        d=law->MinDb()+(law->MaxDb()-law->MinDb())*i/1999.0f;
+        error=abs(law->DbToPosition(d)-ExactPosition(law,d));
+        if (error>maxerror) maxerror=error;
+    }
+
+    // The batch versions should match the single conversions
+    for(i=0;i<SAMPLES;i++) {
+        db[i%(XT_FADER_MAX+1)]=-120+140.0f*i/SAMPLES;
+        if ((i%(XT_FADER_MAX+1))==XT_FADER_MAX) {
+            law->DbToPositions(db,batch,XT_FADER_MAX+1);
+            law->DbToGains(db,gains,XT_FADER_MAX+1);
+            for(position=0;position<=XT_FADER_MAX;position++) {
+                if (batch[position]!=law->DbToPosition(db[position])) mismatches++;
+                if (gains[position]!=XTouchFaderLaw::DbToGain(db[position])) mismatches++;
+            }
+            law->GainsToDb(gains,db,XT_FADER_MAX+1);
+            for(position=0;position<=XT_FADER_MAX;position++) {
+                if (db[position]!=XTouchFaderLaw::GainToDb(gains[position])) mismatches++;
+            }
+        }
+    }
+
+    // The polynomials against the maths library
+    for(i=0;i<SAMPLES;i++) {
+        d=-150+170.0*i/SAMPLES;
+        exact=pow(10.0,d/20.0);
+        if (fabs(XTouchFaderLaw::DbToGain(d)-exact)/exact>maxgain) maxgain=fabs(XTouchFaderLaw::DbToGain(d)-exact)/exact;
+        if (fabs(XTouchFaderLaw::GainToDb(exact)-d)>maxdb) maxdb=fabs(XTouchFaderLaw::GainToDb(exact)-d);
+    }
+
+    printf("  %d round trip errors, dB to position off by up to %d, %d batch mismatches\n",roundtrip,maxerror,mismatches);
+    printf("  dB to gain relative error %.2g, gain to dB error %.2gdB\n",maxgain,maxdb);
+    return (roundtrip==0)&&(maxerror<=1)&&(mismatches==0)&&(maxgain<1e-5)&&(maxdb<1e-3);
+}
+
+static double Now() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC,&ts);
+    return ts.tv_sec+ts.tv_nsec/1e9;
+}
+
+// Each test converts SAMPLES values in batches of n and returns ns per conversion
+// The results are summed so the compiler can't leave anything out
+static volatile float Sink;
+
+double TimeLibm(XTouchFaderLaw *law, const float *db, float *out, int n) {
+    double start=Now();
+    float sum=0;
+    int i;
+    for(i=0;i<SAMPLES;i++) {
+        out[i]=pow(10.0,db[i]/20.0);
+        sum+=out[i];
+    }
+    for(i=0;i<SAMPLES;i++) {
+        out[i]=20*log10(out[i]);
+        sum+=out[i];
+    }
+    Sink=sum;
+    return (Now()-start)*1e9/(2*SAMPLES);
+}
+
+double TimeSingle(XTouchFaderLaw *law, const float *db, float *out, int n) {
+    double start=Now();
+    float sum=0;
+    int i;
+    for(i=0;i<SAMPLES;i++) {
+        out[i]=XTouchFaderLaw::DbToGain(db[i]);
+        sum+=out[i];
+    }
+    for(i=0;i<SAMPLES;i++) {
+        out[i]=XTouchFaderLaw::GainToDb(out[i]);
+        sum+=out[i];
+    }
+    Sink=sum;
+    return (Now()-start)*1e9/(2*SAMPLES);
+}
+
+double TimeBatch(XTouchFaderLaw *law, const float *db, float *out, int n) {
+    static float gains[SAMPLES];
+    double start=Now();
+    int i;
+    for(i=0;i<SAMPLES;i+=n) {
+        law->DbToGains(db+i,gains+i,(SAMPLES-i<n)?SAMPLES-i:n);
+    }
+    for(i=0;i<SAMPLES;i+=n) {
+        law->GainsToDb(gains+i,out+i,(SAMPLES-i<n)?SAMPLES-i:n);
+    }
+    Sink=out[SAMPLES-1];
+    return (Now()-start)*1e9/(2*SAMPLES);
+}
+
+double TimePositionsSingle(XTouchFaderLaw *law, const int *positions, float *db, int n) {
+    double start=Now();
+    float sum=0;
+    int i;
+    for(i=0;i<SAMPLES;i++) {
+        db[i]=law->PositionToDb(positions[i]);
+    }
+    for(i=0;i<SAMPLES;i++) {
+        sum+=law->DbToPosition(db[i]);
+    }
+    Sink=sum;
+    return (Now()-start)*1e9/(2*SAMPLES);
+}
+
+double TimePositionsBatch(XTouchFaderLaw *law, const int *positions, float *db, int n) {
+    static int out[SAMPLES];
+    double start=Now();
+    int i;
+    for(i=0;i<SAMPLES;i+=n) {
+        law->PositionsToDb(positions+i,db+i,(SAMPLES-i<n)?SAMPLES-i:n);
+    }
+    for(i=0;i<SAMPLES;i+=n) {
+        law->DbToPositions(db+i,out+i,(SAMPLES-i<n)?SAMPLES-i:n);
+    }
+    Sink=out[SAMPLES-1];
+    return (Now()-start)*1e9/(2*SAMPLES);
+}
+
+// Best of several runs
+double Best(double (*test)(XTouchFaderLaw*, const float*, float*, int), XTouchFaderLaw *law, const float *in, float *out, int n) {
+    double best=1e30;
+    double t;
+    int run;
+    for(run=0;run<20;run++) {
+        t=test(law,in,out,n);
+        if (t<best) best=t;
+    }
+    return best;
+}
+
+double BestPositions(double (*test)(XTouchFaderLaw*, const int*, float*, int), XTouchFaderLaw *law, const int *in, float *out, int n) {
+    double best=1e30;
+    double t;
+    int run;
+    for(run=0;run<20;run++) {
+        t=test(law,in,out,n);
+        if (t<best) best=t;
+    }
+    return best;
+}
+
+int main(int argc, char **argv) {
+    static float db[SAMPLES];
+    static float out[SAMPLES];
+    static int positions[SAMPLES];
+    int batch=8;
+    int taper;
+    int ok=1;
+    int i;
+
+    while ((i=getopt(argc, argv, "n:"))!=-1) {
+        switch (i) {
+            case 'n': batch=atoi(optarg); break;
+            default:
+                    fprintf(stderr,"Usage: %s [-n batchsize]\n",argv[0]);
+                    exit(1);
+        }
+    }
+    if (batch<1) batch=1;
+
+    XTouchFaderLaw law;
+    for(taper=XT_TAPER_CONSOLE;taper<=XT_TAPER_GAIN;taper++) {
+        law.SetTaper((xt_taper_t)taper);
+        printf("Taper %s (%.1fdB to %.1fdB):\n",TaperNames[taper],law.MinDb(),law.MaxDb());
+        if (!Accuracy(&law)) {
+            printf("  FAILED\n");
+            ok=0;
+        }
+    }
+
+    srand(1);
+    for(i=0;i<SAMPLES;i++) {
+        db[i]=-100+(rand()%12000)/100.0f;
+        positions[i]=rand()%(XT_FADER_MAX+1);
+    }
+    law.SetTaper(XT_TAPER_CONSOLE);
+    printf("\nns per conversion, batches of %d:\n",batch);
+    printf("  dB <-> gain       pow/log10 %6.2f   single %6.2f   batch %6.2f",
+           Best(TimeLibm,&law,db,out,batch),Best(TimeSingle,&law,db,out,batch),Best(TimeBatch,&law,db,out,batch));
+    law.SetSimd(0);
+    printf("   batch without SIMD %6.2f\n",Best(TimeBatch,&law,db,out,batch));
+    law.SetSimd(1);
+    printf("  position <-> dB   single %6.2f   batch %6.2f",
+           BestPositions(TimePositionsSingle,&law,positions,out,batch),BestPositions(TimePositionsBatch,&law,positions,out,batch));
+    law.SetSimd(0);
+    printf("   batch without SIMD %6.2f\n",BestPositions(TimePositionsBatch,&law,positions,out,batch));
+    exit(ok?0:1);
+}
@@ -0,0 +1,700 @@
+/* ------------------------------------------------------------------------------
+   Fleet load generator for the x-touch library.
+   Simulates many X-Touch surfaces on localhost, each sending probes and a mix
+   of fader sweeps, button presses and encoder spins, and times how long the
+   matching feedback takes to come back. The surface count is stepped up to
+   show where a server's throughput and latency start to suffer.
+   Also includes a reference server, built on the XTouch class, that serves
+   any number of surfaces from one UDP port.
+   -----------------------------------------------------------------------------*/
+
+/*
+MIT License
+
+Copyright (c) 2020 Martin Whitaker
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+/* Usage:
+     x-touch-loadgen -S [-p port]
+        Runs the reference server. Every surface that sends to the port gets its own
+        XTouch. Button presses toggle the button's light, fader moves are sent back to
+        the fader and encoder turns move the encoder's ring.
+     x-touch-loadgen [-l] [-h host] [-p port] [-s counts] [-d seconds] [-r rate] [-m mix] [-t timeout]
+        Runs the surfaces against a server (with -l, a reference server started for the test)
+        -s  comma separated surface counts to step through (default 1,10,50,100,200,400)
+        -d  seconds to run each step for (default 5)
+        -r  events per second from each surface (default 20)
+        -m  fader:button:encoder weights for the event mix (default 4:4:2)
+        -t  ms to wait for feedback before counting an event as dropped (default 1000)
+
+   Feedback is matched to events by the message it should produce, oldest first: the
+   button's light in the state the press toggled it to, the fader at the level it was
+   moved to, or the encoder's ring lit to the level the turn took it to. Every message in
+   a datagram is checked, but only one carrying that value counts, so a full refresh of
+   the surface doesn't match events the server hasn't handled yet. Each surface sends the
+   X-Touch probe every 2 seconds, as the real one does to keep the connection alive.
+
+   The reference server serves at most MAXSURFACES at once and forgets surfaces it
+   hasn't heard from for SESSION_TIMEOUT. Surfaces keep their sockets until the run
+   ends, so no step reuses the port of one the server still remembers, and the surface
+   counts of one run can't add up to more than MAXSURFACES.
+
+   Fader events are sent on faders 0-7, buttons 0-31 and encoders 16-23, so the sample
+   application can also be tested one surface at a time.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <math.h>
+#include <time.h>
+#include <signal.h>
+#include <poll.h>
+#include <sys/epoll.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include "x-touch.h"
+
+#define MAXSURFACES 4096
+#define MAXPENDING 64
+#define PROBE_INTERVAL 2000000000LL     // ns
+#define HASHSIZE 16384
+#define SESSION_TIMEOUT 6000000000LL    // ns, three missed probes
+
+static unsigned char probe[] = { 0xf0, 0x00, 0x20, 0x32, 0x58, 0x54, 0x00, 0xf7 };
+
+static int64_t Now() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC,&ts);
+    return (int64_t)ts.tv_sec*1000000000+ts.tv_nsec;
+}
+
+int openudp(unsigned long addr, int port) {
+    struct sockaddr_in serveraddr;
+    int sockfd;
+    int optval;
+
+    sockfd = socket(AF_INET, SOCK_DGRAM, 0);
+    if (sockfd < 0) {
+        perror("ERROR opening socket");
+        return -1;
+    }
+
+    // Not for port 0, or two surfaces can be given the same port
+    optval = 1;
+    if (port) setsockopt(sockfd, SOL_SOCKET, SO_REUSEADDR, (const void *)&optval , sizeof(int));
+    // Big buffers so the kernel isn't what drops packets
+    optval = 4*1024*1024;
+    setsockopt(sockfd, SOL_SOCKET, SO_RCVBUF, (const void *)&optval , sizeof(int));
+
+    memset(&serveraddr, 0, sizeof(serveraddr));
+    serveraddr.sin_family = AF_INET;
+    serveraddr.sin_addr.s_addr = htonl(addr);
+    serveraddr.sin_port = htons((unsigned short)port);
+
+    if (bind(sockfd, (struct sockaddr *) &serveraddr, sizeof(serveraddr)) < 0) {
+        perror("ERROR on binding");
+        close(sockfd);
+        return -1;
+    }
+    return sockfd;
+}
+
+// ----------------------------------------------------------------------------------------------
+// Reference server
+// ----------------------------------------------------------------------------------------------
+
+typedef struct {
+    int sockfd;
+    struct sockaddr_in addr;
+    XTouch *board;
+    int64_t last;
+    int leds[128];
+    int rings[8];
+} session_t;
+
+static session_t *Sessions[MAXSURFACES];
+static int SessionHash[HASHSIZE];       // Index+1 into Sessions, 0 for empty
+static int SessionCount=0;
+
+void sessionsend(void *data, unsigned char *buffer, unsigned int len) {
+    session_t *s=(session_t *)data;
+    sendto(s->sockfd, buffer, len, 0, (struct sockaddr *) &(s->addr), sizeof(s->addr));
+}
+
+void sessionbutton(void *data, unsigned char button, int value) {
+    session_t *s=(session_t *)data;
+    if ((!value)||(button>115)) return;
+    s->leds[button]=!s->leds[button];
+    s->board->SetSingleButton(button,s->leds[button]?ON:OFF);
+}
+
+void sessionfader(void *data, unsigned char fader, int value) {
+    ((session_t *)data)->board->SetFaderLevel(fader,value);
+}
+
+void sessiondial(void *data, unsigned char dial, int value) {
+    session_t *s=(session_t *)data;
+    int ring;
+    if ((dial<16)||(dial>23)) return;
+    ring=dial-16;
+    s->rings[ring]+=value;
+    if (s->rings[ring]<0) s->rings[ring]=0;
+    if (s->rings[ring]>13) s->rings[ring]=13;
+    s->board->SetDialLevel(ring,s->rings[ring]);
+}
+
+static unsigned int sessionhash(struct sockaddr_in *addr) {
+    return ((addr->sin_addr.s_addr*2654435761u)^(addr->sin_port*40503u))%HASHSIZE;
+}
+
+// Finds the session for a surface, adding it if it's new
+// Returns NULL if MAXSURFACES are already being served
+session_t *findsession(int sockfd, struct sockaddr_in *addr) {
+    unsigned int h;
+    session_t *s;
+
+    h=sessionhash(addr);
+    while (SessionHash[h]) {
+        s=Sessions[SessionHash[h]-1];
+        if ((s->addr.sin_addr.s_addr==addr->sin_addr.s_addr)&&(s->addr.sin_port==addr->sin_port)) return s;
+        h=(h+1)%HASHSIZE;
+    }
+    if (SessionCount==MAXSURFACES) return NULL;
+    s=new session_t;
+    memset(s,0,sizeof(session_t));
+    s->sockfd=sockfd;
+    s->addr=*addr;
+    s->board=new XTouch(sessionsend,(void*)s);
+    s->board->RegisterButtonCallback(sessionbutton,(void*)s);
+    s->board->RegisterFaderCallback(sessionfader,(void*)s);
+    s->board->RegisterDialCallback(sessiondial,(void*)s);
+    Sessions[SessionCount++]=s;
+    SessionHash[h]=SessionCount;
+    return s;
+}
+
+// Forgets surfaces that have gone quiet, e.g. those from an earlier step of a test
+void expiresessions(int64_t now) {
+    unsigned int h;
+    int kept=0;
+    int i;
+
+    for(i=0;i<SessionCount;i++) {
+        if (now-Sessions[i]->last>SESSION_TIMEOUT) {
+            delete Sessions[i]->board;
+            delete Sessions[i];
+            continue;
+        }
+        Sessions[kept++]=Sessions[i];
+    }
+    if (kept==SessionCount) return;
+    SessionCount=kept;
+    memset(SessionHash,0,sizeof(SessionHash));
+    for(i=0;i<SessionCount;i++) {
+        h=sessionhash(&Sessions[i]->addr);
+        while (SessionHash[h]) h=(h+1)%HASHSIZE;
+        SessionHash[h]=i+1;
+    }
+}
+
+int RunServer(int port) {
+    static unsigned char buffer[2048];
+    struct pollfd fds;
+    struct sockaddr_in addr;
+    socklen_t addrlen;
+    session_t *s;
+    int sockfd;
+    int recvlen;
+    long packets=0;
+    long refused=0;
+    int64_t lastreport;
+    int64_t now;
+
+    sockfd=openudp(INADDR_LOOPBACK,port);
+    if (sockfd<0) return 0;
+    printf("Serving surfaces on port %d\n",port);
+    fflush(stdout);
+
+    fds.fd=sockfd;
+    fds.events=POLLIN;
+    lastreport=Now();
+    while (1) {
+        if ((poll(&fds,1,1000)<0)&&(errno!=EINTR)) {
+            perror("ERROR in poll");
+            return 0;
+        }
+        now=Now();
+        while (1) {
+            addrlen=sizeof(addr);
+            recvlen=recvfrom(sockfd, buffer, sizeof(buffer), MSG_DONTWAIT, (struct sockaddr *) &addr, &addrlen);
+            if (recvlen<=0) break;
+            s=findsession(sockfd,&addr);
+            if (!s) {
+                refused++;
+                continue;
+            }
+            s->last=now;
+            // The X-Touch sends a message per datagram
+            s->board->HandlePacket(buffer,recvlen);
+            packets++;
+        }
+        now=Now();
+        if (now-lastreport>=5000000000LL) {
+            expiresessions(now);
+            printf("%d surfaces, %.0f packets/s\n",SessionCount,packets*1e9/(now-lastreport));
+            if (refused) printf("Already serving %d surfaces - ignored %ld packets from others\n",MAXSURFACES,refused);
+            fflush(stdout);
+            packets=0;
+            refused=0;
+            lastreport=now;
+        }
+    }
+}
+
+// ----------------------------------------------------------------------------------------------
+// Surfaces
+// ----------------------------------------------------------------------------------------------
+
+typedef struct {
+    unsigned int Key;
+    int Value;                          // What the feedback should carry
+    int64_t Sent;
+} pending_t;
+
+typedef struct {
+    int fd;
+    int connected;
+    int64_t nextevent;
+    int64_t nextprobe;
+    int faders[8];
+    int faderstep[8];
+    int leds[32];                       // As the reference server has them
+    int rings[8];
+    pending_t pending[MAXPENDING];
+    int head;
+    int count;
+} surface_t;
+
+typedef struct {
+    long sent;
+    long matched;
+    long dropped;
+    long received;
+    int64_t *latencies;
+    long latencycount;
+    long latencysize;
+} stats_t;
+
+static surface_t *Surfaces;
+// Sockets stay open until the run ends, so a later step can't get a port the server
+// still has a session for
+static int Sockets[MAXSURFACES];
+static int SocketCount=0;
+static int FaderWeight=4;
+static int ButtonWeight=4;
+static int EncoderWeight=2;
+static double Rate=20;
+static int64_t Timeout=1000000000LL;
+
+// Event times are kept in a heap so the next one due is always on top
+static int *Heap;
+static int HeapCount;
+
+static void HeapSwap(int a, int b) {
+    int t=Heap[a];
+    Heap[a]=Heap[b];
+    Heap[b]=t;
+}
+
+void HeapPush(int surface) {
+    int i=HeapCount++;
+    Heap[i]=surface;
+    while ((i>0)&&(Surfaces[Heap[(i-1)/2]].nextevent>Surfaces[Heap[i]].nextevent)) {
+        HeapSwap(i,(i-1)/2);
+        i=(i-1)/2;
+    }
+}
+
+int HeapPop() {
+    int top=Heap[0];
+    int i=0;
+    int child;
+    Heap[0]=Heap[--HeapCount];
+    while (1) {
+        child=2*i+1;
+        if (child>=HeapCount) break;
+        if ((child+1<HeapCount)&&(Surfaces[Heap[child+1]].nextevent<Surfaces[Heap[child]].nextevent)) child++;
+        if (Surfaces[Heap[i]].nextevent<=Surfaces[Heap[child]].nextevent) break;
+        HeapSwap(i,child);
+        i=child;
+    }
+    return top;
+}
+
+void AddLatency(stats_t *stats, int64_t latency) {
+    if (stats->latencycount==stats->latencysize) {
+        stats->latencysize=stats->latencysize?stats->latencysize*2:65536;
+        stats->latencies=(int64_t*)realloc(stats->latencies,stats->latencysize*sizeof(int64_t));
+    }
+    stats->latencies[stats->latencycount++]=latency;
+}
+
+void AddPending(surface_t *s, unsigned int key, int value, int64_t sent, stats_t *stats) {
+    if (s->count==MAXPENDING) {
+        s->head=(s->head+1)%MAXPENDING;
+        s->count--;
+        stats->dropped++;
+    }
+    s->pending[(s->head+s->count)%MAXPENDING].Key=key;
+    s->pending[(s->head+s->count)%MAXPENDING].Value=value;
+    s->pending[(s->head+s->count)%MAXPENDING].Sent=sent;
+    s->count++;
+}
+
+// Matches a feedback message to the oldest event waiting for it
+void MatchFeedback(surface_t *s, unsigned int key, int value, int64_t now, stats_t *stats) {
+    int i;
+    int j;
+    pending_t *p;
+    for(i=0;i<s->count;i++) {
+        p=&s->pending[(s->head+i)%MAXPENDING];
+        if ((p->Key!=key)||(p->Value!=value)) continue;
+        AddLatency(stats,now-p->Sent);
+        stats->matched++;
+        // Close the gap
+        for(j=i;j>0;j--) {
+            s->pending[(s->head+j)%MAXPENDING]=s->pending[(s->head+j-1)%MAXPENDING];
+        }
+        s->head=(s->head+1)%MAXPENDING;
+        s->count--;
+        return;
+    }
+}
+
+// Drops events that have waited too long for feedback
+void ExpirePending(surface_t *s, int64_t now, stats_t *stats) {
+    while ((s->count)&&(now-s->pending[s->head].Sent>Timeout)) {
+        s->head=(s->head+1)%MAXPENDING;
+        s->count--;
+        stats->dropped++;
+    }
+}
+
+void SendEvent(surface_t *s, int64_t now, stats_t *stats) {
+    unsigned char buffer[3];
+    int pick;
+    int leds;
+    int old;
+    int n;
+
+    pick=rand()%(FaderWeight+ButtonWeight+EncoderWeight);
+    if (pick<FaderWeight) {
+        // Sweep the fader up and down
+        n=rand()%8;
+        if (s->faderstep[n]==0) s->faderstep[n]=512;
+        s->faders[n]+=s->faderstep[n];
+        if ((s->faders[n]<0)||(s->faders[n]>16383)) {
+            s->faderstep[n]=-s->faderstep[n];
+            s->faders[n]+=2*s->faderstep[n];
+        }
+        buffer[0]=0xe0+n;
+        buffer[1]=s->faders[n]&0x7f;
+        buffer[2]=(s->faders[n]>>7)&0x7f;
+        send(s->fd,buffer,3,0);
+        AddPending(s,(buffer[0]<<8),s->faders[n],now,stats);
+    } else if (pick<FaderWeight+ButtonWeight) {
+        n=rand()%32;
+        buffer[0]=0x90;
+        buffer[1]=n;
+        buffer[2]=0x7f;
+        send(s->fd,buffer,3,0);
+        s->leds[n]=!s->leds[n];
+        AddPending(s,0x9000+n,s->leds[n]?ON:OFF,now,stats);
+        buffer[2]=0x00;
+        send(s->fd,buffer,3,0);
+    } else {
+        n=rand()%8;
+        buffer[0]=0xb0;
+        buffer[1]=16+n;
+        buffer[2]=(rand()&1)?0x01:0x41;
+        send(s->fd,buffer,3,0);
+        old=(1<<s->rings[n])-1;
+        s->rings[n]+=(buffer[2]&0x40)?-1:1;
+        if (s->rings[n]<0) s->rings[n]=0;
+        if (s->rings[n]>13) s->rings[n]=13;
+        // The ring is lit up to its level by two controllers, the first 7 LEDs then the rest
+        // Wait for whichever one the turn changed
+        leds=(1<<s->rings[n])-1;
+        if ((leds&0x7f)!=(old&0x7f)) {
+            AddPending(s,0xb030+n,leds&0x7f,now,stats);
+        } else {
+            AddPending(s,0xb038+n,leds>>7,now,stats);
+        }
+    }
+    stats->sent++;
+}
+
+// Reads everything waiting for a surface
+// Feedback may be batched, so every message in a datagram is checked, following running status
+void Receive(surface_t *s, stats_t *stats) {
+    unsigned char buffer[2048];
+    unsigned char status;
+    int len;
+    int i;
+    int n;
+    int64_t now;
+    while ((len=recv(s->fd,buffer,sizeof(buffer),MSG_DONTWAIT))>0) {
+        now=Now();
+        stats->received++;
+        ExpirePending(s,now,stats);
+        if ((len==8)&&(buffer[0]==0xf0)&&(buffer[6]==0x01)) s->connected=1;   // Probe response
+        i=0;
+        status=0;
+        while (i<len) {
+            if (buffer[i]==0xf0) {
+                while ((i<len)&&(buffer[i]!=0xf7)) i++;
+                i++;
+                status=0;
+                continue;
+            }
+            if (buffer[i]&0x80) status=buffer[i++];
+            if (status==0) {
+                i++;
+                continue;
+            }
+            n=(((status&0xf0)==0xc0)||((status&0xf0)==0xd0))?1:2;
+            if (i+n>len) break;
+            if ((status&0xf0)==0xe0) {
+                MatchFeedback(s,status<<8,buffer[i]|(buffer[i+1]<<7),now,stats);
+            } else if ((status==0x90)||(status==0xb0)) {
+                MatchFeedback(s,(status<<8)|buffer[i],buffer[i+1],now,stats);
+            }
+            i+=n;
+        }
+    }
+}
+
+static int CompareLatency(const void *a, const void *b) {
+    int64_t x=*(const int64_t*)a;
+    int64_t y=*(const int64_t*)b;
+    return (x<y)?-1:(x>y)?1:0;
+}
+
+static double Percentile(stats_t *stats, double p) {
+    long i;
+    if (stats->latencycount==0) return 0;
+    i=(long)(p*(stats->latencycount-1)+0.5);
+    return stats->latencies[i]/1000.0;
+}
+
+// Runs count surfaces for the given time and prints a line of results
+// Returns 0 if the surfaces couldn't be set up
+int RunStep(struct sockaddr_in *server, int count, int seconds) {
+    struct epoll_event event;
+    struct epoll_event events[256];
+    stats_t stats;
+    surface_t *s;
+    int64_t now;
+    int64_t start;
+    int64_t end;
+    int64_t wait;
+    int epfd;
+    int connected=0;
+    int n;
+    int i;
+
+    memset(&stats,0,sizeof(stats));
+    Surfaces=(surface_t*)calloc(count,sizeof(surface_t));
+    Heap=(int*)malloc(count*sizeof(int));
+    HeapCount=0;
+    epfd=epoll_create1(0);
+
+    start=Now();
+    for(i=0;i<count;i++) {
+        s=&Surfaces[i];
+        s->fd=openudp(INADDR_LOOPBACK,0);
+        if ((s->fd<0)||(connect(s->fd,(struct sockaddr*)server,sizeof(*server))<0)) {
+            if (s->fd>=0) perror("ERROR connecting");
+            count=i;
+            break;
+        }
+        event.events=EPOLLIN;
+        event.data.u32=i;
+        epoll_ctl(epfd,EPOLL_CTL_ADD,s->fd,&event);
+        send(s->fd,probe,sizeof(probe),0);
+        s->nextprobe=start+PROBE_INTERVAL;
+        // Spread the first events out so the surfaces don't all start together
+        s->nextevent=start+(int64_t)(1e9/Rate*rand()/RAND_MAX);
+        HeapPush(i);
+    }
+
+    end=start+(int64_t)seconds*1000000000;
+    while (count>0) {
+        now=Now();
+        if (now>=end+Timeout) break;
+        // Due events, then wait for feedback until the next one
+        while ((now<end)&&(HeapCount)&&(Surfaces[Heap[0]].nextevent<=now)) {
+            i=HeapPop();
+            s=&Surfaces[i];
+            ExpirePending(s,now,&stats);
+            SendEvent(s,now,&stats);
+            if (now>=s->nextprobe) {
+                send(s->fd,probe,sizeof(probe),0);
+                s->nextprobe+=PROBE_INTERVAL;
+            }
+            s->nextevent+=(int64_t)(-log((rand()+1.0)/(RAND_MAX+2.0))*1e9/Rate);
+            if (s->nextevent<now) s->nextevent=now;
+            HeapPush(i);
+        }
+        wait=((now<end)&&(HeapCount))?Surfaces[Heap[0]].nextevent-now:end+Timeout-now;
+        n=epoll_wait(epfd,events,256,(int)(wait/1000000));
+        for(i=0;i<n;i++) {
+            Receive(&Surfaces[events[i].data.u32],&stats);
+        }
+    }
+    now=Now();
+    for(i=0;i<count;i++) {
+        Receive(&Surfaces[i],&stats);
+        ExpirePending(&Surfaces[i],now,&stats);
+        stats.dropped+=Surfaces[i].count;
+        connected+=Surfaces[i].connected;
+        Sockets[SocketCount++]=Surfaces[i].fd;
+    }
+    close(epfd);
+
+    qsort(stats.latencies,stats.latencycount,sizeof(int64_t),CompareLatency);
+    printf("%8d %9d %10.0f %10.0f %7.2f%% %9.0f %9.0f %9.0f %9.0f\n",count,connected,stats.sent/(double)seconds,
+           stats.matched/(double)seconds,stats.sent?100.0*stats.dropped/stats.sent:0.0,
+           Percentile(&stats,0.5),Percentile(&stats,0.99),Percentile(&stats,0.999),
+           stats.latencycount?stats.latencies[stats.latencycount-1]/1000.0:0.0);
+    fflush(stdout);
+
+    free(stats.latencies);
+    free(Heap);
+    free(Surfaces);
+    return count>0;
+}
+
+int main(int argc, char **argv) {
+    const char *host="127.0.0.1";
+    const char *counts="1,10,50,100,200,400";
+    const char *p;
+    struct sockaddr_in server;
+    struct rlimit limit;
+    int serve=0;
+    int local=0;
+    int port=10111;
+    int seconds=5;
+    int count;
+    int total=0;
+    pid_t child=0;
+    int i;
+
+    while ((i=getopt(argc, argv, "Slh:p:s:d:r:m:t:"))!=-1) {
+        switch (i) {
+            case 'S': serve=1; break;
+            case 'l': local=1; break;
+            case 'h': host=optarg; break;
+            case 'p': port=atoi(optarg); break;
+            case 's': counts=optarg; break;
+            case 'd': seconds=atoi(optarg); break;
+            case 'r': Rate=atof(optarg); break;
+            case 'm':
+                    if (sscanf(optarg,"%d:%d:%d",&FaderWeight,&ButtonWeight,&EncoderWeight)!=3) FaderWeight=-1;
+                    break;
+            case 't': Timeout=atoi(optarg)*1000000LL; break;
+            default:
+                    fprintf(stderr,"Usage: %s -S [-p port]\n",argv[0]);
+                    fprintf(stderr,"       %s [-l] [-h host] [-p port] [-s counts] [-d seconds] [-r rate] [-m fader:button:encoder] [-t timeout_ms]\n",argv[0]);
+                    exit(1);
+        }
+    }
+    if ((FaderWeight<0)||(ButtonWeight<0)||(EncoderWeight<0)||(FaderWeight+ButtonWeight+EncoderWeight==0)||
+        (Rate<=0)||(seconds<1)||(Timeout<=0)) {
+        fprintf(stderr,"Bad mix, rate, time or timeout\n");
+        exit(1);
+    }
+
+    if (serve) exit(RunServer(port)?0:1);
+
+    // Every surface of the run has its own session on the server
+    for(p=counts;*p;) {
+        count=atoi(p);
+        if ((count<1)||(count>MAXSURFACES)) {
+            fprintf(stderr,"Surface counts must be 1 to %d\n",MAXSURFACES);
+            exit(1);
+        }
+        total+=count;
+        while ((*p)&&(*p!=',')) p++;
+        if (*p==',') p++;
+    }
+    if (total>MAXSURFACES) {
+        fprintf(stderr,"Surface counts add up to %d, but the server only serves %d at once\n",total,MAXSURFACES);
+        exit(1);
+    }
+
+    // A socket per surface
+    getrlimit(RLIMIT_NOFILE,&limit);
+    limit.rlim_cur=limit.rlim_max;
+    setrlimit(RLIMIT_NOFILE,&limit);
+
+    memset(&server,0,sizeof(server));
+    server.sin_family=AF_INET;
+    server.sin_port=htons((unsigned short)port);
+    if (!inet_aton(host,&server.sin_addr)) {
+        fprintf(stderr,"Bad host address %s\n",host);
+        exit(1);
+    }
+
+    if (local) {
+        child=fork();
+        if (child==0) {
+            exit(RunServer(port)?0:1);
+        }
+        usleep(200000);
+    }
+
+    printf("%.0f events/s per surface, mix %d:%d:%d fader:button:encoder, %ds per step\n",Rate,FaderWeight,ButtonWeight,EncoderWeight,seconds);
+    printf("Surfaces Connected   Events/s Feedback/s    Drops   p50(us)   p99(us)  p999(us)   max(us)\n");
+    srand(1);
+    for(p=counts;*p;) {
+        count=atoi(p);
+        if (!RunStep(&server,count,seconds)) break;
+        while ((*p)&&(*p!=',')) p++;
+        if (*p==',') p++;
+    }
+
+    for(i=0;i<SocketCount;i++) {
+        close(Sockets[i]);
+    }
+    if (child>0) {
+        kill(child,SIGTERM);
+        waitpid(child,NULL,0);
+    }
+    exit(0);
+}
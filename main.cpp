@@ -47,167 +47,285 @@ SOFTWARE.
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include <sys/socket.h>
-#include <netinet/in.h>
+#include <unistd.h>
+#include <errno.h>
+#include <signal.h>
 #include <time.h>
 
 #include "x-touch.h"
-
-#define BUFSIZE 1508
-
-typedef struct {
-    int sockfd;
-    socklen_t clientlen;
-    struct sockaddr_in clientaddr;
-} socketinfo_t;
-
-typedef struct {
-    xt_ScribblePad_t pad;
-    int mainlevel;
-    int mute;
-    int trimlevel;
-    int pan;
-    int solo;
-    int rec;
-    int mode;
-} channelinfo_t;
-
-channelinfo_t channels[64];
+#include "x-touch-mapping.h"
+#include "x-touch-channels.h"
+#include "x-touch-transport.h"
+#include "x-touch-scheduler.h"
+#include "x-touch-scribble.h"
+#include "x-touch-fader.h"
+#include "x-touch-coro.h"
+#include "x-touch-shm.h"
+#include "x-touch-automation.h"
+#include "x-touch-leds.h"
+#include "x-touch-trace.h"
+
+enum { PARAM_REC, PARAM_SOLO, PARAM_MUTE, PARAM_SELECT, PARAM_MODE, PARAM_ADJUST, PARAM_LEVEL, PARAM_MASTER, PARAM_JOG, PARAM_AUTOMODE, PARAM_AUTOGROUP, PARAM_TRANSPORT };
+
+// Used when no mapping file is given with -m. See x-touch-mapping.h for the format
+// The number of channels on the desk is the number of banks times 8
+const char *defaultmapping=
+    "banks 8 8\n"
+    "button 0-7 toggle rec strip\n"
+    "button 8-15 toggle solo strip\n"
+    "button 16-23 toggle mute strip\n"
+    "button 24-31 toggle select strip\n"
+    "button 32-39 toggle mode strip\n"   // Pressing the dials at the top
+    "button 46 bankdown\n"
+    "button 47 bankup\n"
+    "dial 16-23 relative adjust strip\n"
+    "dial 60 relative jog\n"
+    "fader 0-7 absolute level strip\n"
+    "fader 8 absolute master\n"
+    "button 74-78 momentary automode\n"    // Read, write, trim, touch, latch
+    "button 79 momentary autogroup\n"
+    "button 91-94 momentary transport\n";  // Rewind, fast forward, stop, play
+
+XTouchChannelStore *channels;
+XTouchScribble *scribble;
+XTouchShmPublisher *publisher=NULL;
+XTouchFaderLaw faderlaw;
+XTouchSurface *surface;
+XTouchAutomation *automation;
+const char *autofile=NULL;
+int autogroup=0;
+// Automation mode of each automation button. Trim isn't supported, so it turns automation off
+const xt_auto_mode_t automodes[5]={ XT_AUTO_READ, XT_AUTO_WRITE, XT_AUTO_OFF, XT_AUTO_TOUCH, XT_AUTO_LATCH };
+struct timespec nexttick;
+XTouchLeds *leds;
+struct timespec nextledtick;
+int playblink=0;
+XTouchTrace *trace=NULL;
+volatile sig_atomic_t quit=0;
+
+XTouchMapping mapping;
+volatile sig_atomic_t reloadmapping=0;
 
 int selected=0;
-int page=0;
 int masterlevel=0;
+int soloindicator=0;
 
-void RenderDial(XTouch *board, int channel) {
-    switch (channels[page*8+channel].mode) {
+void RenderDial(XTouch *board, int strip) {
+    const char *label="";
+    int channel=channels->WindowStart()+strip;
+
+    switch (channels->Mode(channel)) {
         case 0: // Pan mode
-                sprintf(channels[page*8+channel].pad.TopText,"PAN");
-                board->SetDialPan(channel, channels[page*8+channel].pan);
+                label="PAN";
+                leds->SetRing(strip, XTouchLeds::PanRing(channels->Pan(channel)));
                 break;
         case 1: // Trim mode
-                sprintf(channels[page*8+channel].pad.TopText,"TRIM");
-                board->SetDialLevel(channel, channels[page*8+channel].trimlevel);
+                label="TRIM";
+                leds->SetRing(strip, XTouchLeds::LevelRing(channels->Trim(channel)));
                 break;
         case 2: // Colour mode
-                sprintf(channels[page*8+channel].pad.TopText,"Col");
-                board->SetDialLevel(channel, 0);
+                label="Col";
+                leds->SetRing(strip, 0);
                 break;
         default: break;
     }
-    board->SetScribble(channel,channels[page*8+channel].pad);
+    // Names too long for the scribble pad scroll
+    scribble->SetText(strip,label,channels->Name(channel));
+    scribble->SetColour(strip,channels->Colour(channel));
 }
 
-void RenderLEDS(XTouch *board, int channel) {
-    if (channels[page*8+channel].rec>0) {
-        board->SetSingleButton(0+channel,FLASHING);
+void RenderLEDS(XTouch *board, int strip) {
+    int channel=channels->WindowStart()+strip;
+    if (channels->Rec(channel)) {
+        leds->SetButton(0+strip,FLASHING);
     } else {
-        board->SetSingleButton(0+channel,OFF);
+        leds->SetButton(0+strip,OFF);
     }
-    if (channels[page*8+channel].solo>0) {
-        board->SetSingleButton(8+channel,ON);
+    if (channels->Solo(channel)) {
+        leds->SetButton(8+strip,ON);
     } else {
-        board->SetSingleButton(8+channel,OFF);
+        leds->SetButton(8+strip,OFF);
     }
-    if (channels[page*8+channel].mute>0) {
-        board->SetSingleButton(16+channel,ON);
+    if (channels->Mute(channel)) {
+        leds->SetButton(16+strip,ON);
     } else {
-        board->SetSingleButton(16+channel,OFF);
+        leds->SetButton(16+strip,OFF);
     }
 }
 
 void RenderSelectedButton(XTouch *board) {
     int i;
     for(i=0;i<8;i++) {
-        if (selected==page*8+i) {
-            board->SetSingleButton(24+i,ON);
+        if (selected==channels->WindowStart()+i) {
+            leds->SetButton(24+i,ON);
+        } else {
+            leds->SetButton(24+i,OFF);
+        }
+    }
+}
+
+// Lights the selected channel's automation mode, group whilst it's held and play whilst playing
+void RenderAutomation(XTouch *board) {
+    xt_auto_mode_t mode=automation->Mode(selected);
+    int i;
+    for(i=0;i<5;i++) {
+        if ((mode!=XT_AUTO_OFF)&&(automodes[i]==mode)) {
+            leds->SetButton(74+i,ON);
         } else {
-            board->SetSingleButton(24+i,OFF);
+            leds->SetButton(74+i,OFF);
         }
     }
+    leds->SetButton(79,autogroup?ON:OFF);
+    leds->SetButton(94,automation->Playing()?ON:OFF);
+    // Play blinks once a second whilst playing
+    if ((automation->Playing())&&(!playblink)) playblink=leds->Blink(94,94,1000/XT_LEDS_TICK_MS,500/XT_LEDS_TICK_MS);
+    if ((!automation->Playing())&&(playblink)) {
+        leds->Stop(playblink);
+        playblink=0;
+    }
 }
 
 void RenderPageAndSelected(XTouch *board) {
-    board->SetAssignment(page+1);
+    board->SetAssignment(channels->Bank()+1);
     board->SetFrames(selected+1);
+    if (publisher) {
+        publisher->SetSelected(selected);
+        publisher->SetBank(channels->Bank());
+    }
+    RenderAutomation(board);
 }
 
-void RenderPage(XTouch *board) {
+// Redraws only the strips in the visible bank whose channel state has changed
+void Render(XTouch *board) {
+    uint64_t dirty;
     int i;
 
-    for(i=0;i<8;i++) {
-        RenderDial(board, i);
-        RenderLEDS(board,i);
-        board->SetFaderLevel(i,channels[page*8+i].mainlevel);
+    dirty=channels->DirtyInWindow(XT_CH_MODE)|channels->DirtyInWindow(XT_CH_PAN)|channels->DirtyInWindow(XT_CH_TRIM)|
+          channels->DirtyInWindow(XT_CH_NAME)|channels->DirtyInWindow(XT_CH_COLOUR);
+    for(i=0;dirty;i++,dirty>>=1) {
+        if (dirty&1) RenderDial(board,i);
+    }
+    dirty=channels->DirtyInWindow(XT_CH_REC)|channels->DirtyInWindow(XT_CH_SOLO)|channels->DirtyInWindow(XT_CH_MUTE);
+    for(i=0;dirty;i++,dirty>>=1) {
+        if (dirty&1) RenderLEDS(board,i);
     }
+    dirty=channels->DirtyInWindow(XT_CH_LEVEL);
+    for(i=0;dirty;i++,dirty>>=1) {
+        if (dirty&1) board->SetFaderLevel(i,channels->Level(channels->WindowStart()+i));
+    }
+    channels->ClearWindowDirty();
+    scribble->Update();
+
+    // The solo light by the timecode display shows if anything on the desk is soloed
+    if (channels->AnySolo()!=soloindicator) {
+        soloindicator=channels->AnySolo();
+        leds->SetButton(115,soloindicator?ON:OFF);
+    }
+}
+
+void RenderPage(XTouch *board) {
+    channels->MarkWindowDirty();
+    Render(board);
     board->SetFaderLevel(8,masterlevel);
     RenderPageAndSelected(board);
     RenderSelectedButton(board);
 }
 
-void sendpacket(void *socket, unsigned char *buffer, unsigned int len) {
-    socketinfo_t *udpsocket=(socketinfo_t *)socket;
-    sendto(udpsocket->sockfd, buffer, len, 0, (struct sockaddr *) &(udpsocket->clientaddr), (udpsocket->clientlen));
+void packetreceived(void *data, unsigned char *buffer, unsigned int len) {
+    XTouch *board=(XTouch*)data;
+    time_t now;
+    struct tm* localtm;
+
+    now = time(0);
+    localtm = localtime(&now);
+    board->SetTime(localtm);
+    board->HandlePacket(buffer,len);
+    // Each stage of the response is marked in the trace (with -T)
+    if (trace) trace->BeginSpan("Render");
+    Render(board);
+    if (trace) trace->EndSpan();
+    if (trace) trace->BeginSpan("LEDs");
+    leds->Update();
+    if (trace) trace->EndSpan();
+    if (trace) trace->BeginSpan("Tasks");
+    surface->Run();
+    if (trace) trace->EndSpan();
+}
+
+// Shows a value over the top line of a channel's scribble pad for a second, if it's in view
+void ShowValue(int channel, const char *format, int value) {
+    char text[16];
+    int strip=channel-channels->WindowStart();
+    if ((strip<0)||(strip>=channels->WindowSize())) return;
+    snprintf(text,sizeof(text),format,value);
+    scribble->ShowOverlay(strip,text,NULL,1000/XT_SCRIBBLE_TICK_MS);
+}
+
+// Fader levels are shown in dB, e.g. "-3.5dB"
+void ShowLevel(int channel, int level) {
+    char text[16];
+    float db=faderlaw.PositionToDb(level);
+    int strip=channel-channels->WindowStart();
+    if ((strip<0)||(strip>=channels->WindowSize())) return;
+    if (db<=XT_FADER_OFF_DB) {
+        snprintf(text,sizeof(text),"-inf");
+    } else if (db<=-10) {
+        snprintf(text,sizeof(text),"%.0fdB",db);
+    } else {
+        snprintf(text,sizeof(text),"%.1fdB",db);
+    }
+    scribble->ShowOverlay(strip,text,NULL,1000/XT_SCRIBBLE_TICK_MS);
+}
+
+// Returns how many ms until next, or 0 if it's due now, in which case next is moved on by interval
+int Due(struct timespec *next, int interval) {
+    struct timespec now;
+    int wait;
+
+    clock_gettime(CLOCK_MONOTONIC,&now);
+    wait=(next->tv_sec-now.tv_sec)*1000+(next->tv_nsec-now.tv_nsec)/1000000;
+    if (wait>0) return wait;
+    *next=now;
+    next->tv_nsec+=interval*1000000;
+    if (next->tv_nsec>=1000000000) {
+        next->tv_sec++;
+        next->tv_nsec-=1000000000;
+    }
+    return 0;
+}
+
+// Animates the scribble pads. Returns how many ms until it's next needed
+int TickScribble() {
+    int wait=Due(&nexttick,XT_SCRIBBLE_TICK_MS);
+    if (wait>0) return wait;
+    scribble->Tick();
+    return XT_SCRIBBLE_TICK_MS;
+}
+
+// Animates the lights. Returns how many ms until it's next needed
+int TickLeds() {
+    int wait=Due(&nextledtick,XT_LEDS_TICK_MS);
+    if (wait>0) return wait;
+    leds->Tick();
+    return XT_LEDS_TICK_MS;
 }
 
 void buttonpressed(void *data, unsigned char button, int value)
 {
-    int channel;
-    int t;
     if (value) {
         printf("Button %d pressed\n",button);
     } else {
         printf("Button %d released\n",button);        
     }
-    if (button<40) {
-        // For rec / solo / mute / select buttons handle these explicitly
-        if (value) {
-            channel=button%8;
-            t=button/8;
-            switch(t) {
-                case 0: // Rec
-                        channels[page*8+channel].rec=1-channels[page*8+channel].rec;
-                        break;
-                case 1: // Solo
-                        channels[page*8+channel].solo=1-channels[page*8+channel].solo;
-                        break;
-                case 2: // Mute
-                        channels[page*8+channel].mute=1-channels[page*8+channel].mute;
-                        break;
-                case 3: // Select
-                        selected=page*8+channel;
-                        RenderSelectedButton((XTouch*)data);
-                        RenderPageAndSelected((XTouch*)data);
-                        break;
-                case 4: // Pressing the dials at the top
-                        channels[page*8+channel].mode++;
-                        if (channels[page*8+channel].mode>2) channels[page*8+channel].mode=0;
-                        RenderDial((XTouch*)data,channel);            
-                        break;
-            }
-            RenderLEDS((XTouch*)data,channel);
-        }
-    } else {
-        // For other buttons light the button whilst pressed
+    // Buttons that don't toggle a parameter are lit whilst pressed
+    if (mapping.ButtonMode(button)!=XT_MAP_TOGGLE) {
         if (value) {
-            ((XTouch*)data)->SetSingleButton(button,ON);
+            leds->SetButton(button,ON);
         } else {
-            ((XTouch*)data)->SetSingleButton(button,OFF);            
-        }
-        // Handle the paging buttons
-        if (value) {
-            if (button==46) {
-                // Previous page
-                if (page>0) page--;
-                RenderPage((XTouch*)data);
-            }
-            if (button==47) {
-                // Next page
-                if (page<7) page++;
-                RenderPage((XTouch*)data);
-            }
+            leds->SetButton(button,OFF);            
         }
     }
-    
+    mapping.HandleButton(button,value);
 }
 
 void fadertouch(void *data, unsigned char fader, int value)
@@ -216,144 +334,357 @@ void fadertouch(void *data, unsigned char fader, int value)
         printf("Fader %d pressed\n",fader);
     } else {
         printf("Fader %d released\n",fader);
-        if (fader<8) {
-            ((XTouch*)data)->SetFaderLevel(fader,channels[page*8+fader].mainlevel);
-        } else {
-            ((XTouch*)data)->SetFaderLevel(fader,masterlevel);            
-        }
     }
+    if (fader<8) automation->Touch(channels->WindowStart()+fader,value);
+    surface->Post(XT_EVENT_TOUCH,fader,value);
+}
+
+// Called when automation moves a channel's fader. Render() sends it if it's in view
+void automationlevel(void *data, int channel, int level)
+{
+    channels->SetLevel(channel,level);
 }
 
 void faderlevel(void *data, unsigned char fader, int value)
 {
     printf("Fader %d level %d\n",fader, value);
-    if (fader<8) {
-        channels[page*8+fader].mainlevel=value;
-    } else {
-        masterlevel=value;
+    mapping.HandleFader(fader,value);
+    surface->Post(XT_EVENT_FADER,fader,value);
+}
+
+// Follows a channel fader from when it's touched until it's let go. The mapping has
+// already stored the moves, so it then only has to put the fader where the desk has it
+// (which can differ, e.g. if the bank was changed whilst it was held)
+XTouchTask FollowFader(XTouchSurface &surface, int fader) {
+    xt_event_t event;
+    int moves;
+    int level;
+
+    while (1) {
+        co_await surface.FaderTouched(fader);
+        moves=0;
+        do {
+            event=co_await surface.NextEvent(XT_EVENT_FADER|XT_EVENT_TOUCH,fader);
+            if (event.Type==XT_EVENT_FADER) moves++;
+        } while ((event.Type!=XT_EVENT_TOUCH)||(event.Value));
+        level=channels->Level(channels->WindowStart()+fader);
+        surface.Board()->SetFaderLevel(fader,level);
+        co_await surface.Flush();
+        printf("Channel %d left at %.1fdB after %d moves\n",channels->WindowStart()+fader+1,faderlaw.PositionToDb(level),moves);
+    }
+}
+
+XTouchTask FollowMaster(XTouchSurface &surface) {
+    while (1) {
+        co_await surface.FaderTouched(8);
+        co_await surface.FaderReleased(8);
+        surface.Board()->SetFaderLevel(8,masterlevel);
+        co_await surface.Flush();
+        printf("Master left at %.1fdB\n",faderlaw.PositionToDb(masterlevel));
     }
 }
 
 void dial(void *data, unsigned char dial, int value)
 {
-    int channel;
     if (value>0) {
         printf("Dial %d clockwise by %d clicks\n", dial, value);
     } else {
         printf("Dial %d anti-clockwise by %d clicks\n", dial, 0-value);
     }
-    if ((dial>15)&&(dial<24)) {
-        channel=dial-16;
-        if (value>0) {
-            switch (channels[page*8+channel].mode) {
-                case 0: // Pan
-                        if (channels[page*8+channel].pan<6)  channels[page*8+channel].pan++;
-                        break;
-                case 1: // Trim
-                        if (channels[page*8+channel].trimlevel<13)  channels[page*8+channel].trimlevel++;
-                        break;
-                case 2: // Colour
-                        if (channels[page*8+channel].pad.Colour<WHITE) channels[page*8+channel].pad.Colour=(xt_colours_t)(((int)(channels[page*8+channel].pad.Colour))+1);
-                        break;
-            }
-        } else {
-            switch (channels[page*8+channel].mode) {
-                case 0: // Pan
-                        if (channels[page*8+channel].pan>-6)  channels[page*8+channel].pan--;
-                        break;
-                case 1: // Trim
-                        if (channels[page*8+channel].trimlevel>0)  channels[page*8+channel].trimlevel--;
-                        break;
-                case 2: // Colour
-                        if (channels[page*8+channel].pad.Colour>BLACK) channels[page*8+channel].pad.Colour=(xt_colours_t)(((int)(channels[page*8+channel].pad.Colour))-1);
-                        break;
-            }            
-        }
-        RenderDial((XTouch*)data, channel);
-    }
-    if (dial==60) {
-        if (value>0) {
-            if (selected<63) selected++;
-        } else {
-            if (selected>0) selected--;            
-        }
-        RenderPageAndSelected((XTouch*)data);
-        RenderSelectedButton((XTouch*)data);
-    }
+    mapping.HandleDial(dial,value);
 }
 
-int main(int argc, char **argv) {
-    struct sockaddr_in serveraddr;
-    unsigned char recvbuf[BUFSIZE];
-    int optval;
-    int recvlen;
-    int i;
-    time_t now;
-    struct tm* localtm;
+void bankchanged(void *data, unsigned char unused, int bank)
+{
+    channels->SetBank(bank);
+    RenderPage((XTouch*)data);
+}
 
-    socketinfo_t udpsocket;
+// Called by the mapping for every control bound to one of the PARAM_ IDs
+// Changes are only recorded here - Render() draws them once the packet has been handled
+void parameterchanged(void *data, int param, int channel, int value)
+{
+    XTouch *board=(XTouch*)data;
+    int step=(value>0)?1:-1;
+    xt_auto_mode_t mode;
+    int i;
 
-    // ------------------------------------------------------------------------------------
-    // Perform socket related initilisations
-    udpsocket.sockfd = socket(AF_INET, SOCK_DGRAM, 0);
-    if (udpsocket.sockfd < 0) {
-        perror("ERROR opening socket");
-        exit(1);
+    switch(param) {
+        case PARAM_REC:
+                channels->SetRec(channel,!channels->Rec(channel));
+                break;
+        case PARAM_SOLO:
+                channels->SetSolo(channel,!channels->Solo(channel));
+                break;
+        case PARAM_MUTE:
+                channels->SetMute(channel,!channels->Mute(channel));
+                break;
+        case PARAM_SELECT:
+                if ((channel<0)||(channel>=channels->Channels())) break;
+                selected=channel;
+                RenderSelectedButton(board);
+                RenderPageAndSelected(board);
+                break;
+        case PARAM_MODE:
+                channels->SetMode(channel,(channels->Mode(channel)+1)%3);
+                break;
+        case PARAM_ADJUST:
+                switch (channels->Mode(channel)) {
+                    case 0: // Pan
+                            channels->SetPan(channel,channels->Pan(channel)+step);
+                            ShowValue(channel,"%+d",channels->Pan(channel));
+                            break;
+                    case 1: // Trim
+                            channels->SetTrim(channel,channels->Trim(channel)+step);
+                            ShowValue(channel,"%d",channels->Trim(channel));
+                            break;
+                    case 2: // Colour
+                            if ((channels->Colour(channel)+step>=BLACK)&&(channels->Colour(channel)+step<=WHITE)) {
+                                channels->SetColour(channel,(xt_colours_t)(channels->Colour(channel)+step));
+                            }
+                            break;
+                }
+                break;
+        case PARAM_LEVEL:
+                // The fader is already where the user put it, so don't send it back
+                channels->SetLevel(channel,value);
+                channels->ClearDirty(XT_CH_LEVEL,channel);
+                automation->Move(channel,value);
+                ShowLevel(channel,value);
+                break;
+        case PARAM_MASTER:
+                masterlevel=value;
+                break;
+        case PARAM_JOG:
+                if (value>0) {
+                    if (selected<channels->Channels()-1) selected++;
+                } else {
+                    if (selected>0) selected--;            
+                }
+                RenderPageAndSelected(board);
+                RenderSelectedButton(board);
+                break;
+        case PARAM_AUTOMODE:
+                // Pressing the lit mode turns automation off. Held with group, it sets every channel
+                if ((value)&&(channel>=0)&&(channel<5)) {
+                    mode=automodes[channel];
+                    if (automation->Mode(selected)==mode) mode=XT_AUTO_OFF;
+                    if (autogroup) {
+                        for(i=0;i<channels->Channels();i++) automation->SetMode(i,mode);
+                    } else {
+                        automation->SetMode(selected,mode);
+                    }
+                }
+                RenderAutomation(board);
+                break;
+        case PARAM_AUTOGROUP:
+                autogroup=value;
+                RenderAutomation(board);
+                break;
+        case PARAM_TRANSPORT:
+                if (value) {
+                    switch (channel) {
+                        case 0: // Rewind
+                                automation->Locate(0);
+                                break;
+                        case 1: // Fast forward
+                                automation->Locate(automation->Position()+5000);
+                                break;
+                        case 2: // Stop. Each pass is saved as soon as it's finished
+                                automation->Stop();
+                                if (autofile) automation->Save(autofile);
+                                break;
+                        case 3: // Play
+                                automation->Play();
+                                break;
+                    }
+                }
+                RenderAutomation(board);
+                break;
     }
+}
 
-    optval = 1;
-    setsockopt(udpsocket.sockfd, SOL_SOCKET, SO_REUSEADDR, (const void *)&optval , sizeof(int));
+void hangup(int sig)
+{
+    reloadmapping=1;
+}
 
-    memset(&serveraddr, 0, sizeof(serveraddr));
-    serveraddr.sin_family = AF_INET;
-    serveraddr.sin_addr.s_addr = htonl(INADDR_ANY);
-    serveraddr.sin_port = htons((unsigned short)10111);
+void interrupted(int sig)
+{
+    quit=1;
+}
 
-    if (bind(udpsocket.sockfd, (struct sockaddr *) &serveraddr, sizeof(serveraddr)) < 0) {
-        perror("ERROR on binding");
-        exit(1);
-    }
+// Called on exit so the trace file is always finished
+void FinishTrace()
+{
+    if (!trace) return;
+    printf("Wrote %u trace events\n",trace->Events());
+    delete trace;
+    trace=NULL;
+}
 
-    udpsocket.clientlen = sizeof(udpsocket.clientaddr);
-    // ------------------------------------------------------------------------------------
+int LoadMapping(const char *filename)
+{
+    if (filename) return mapping.Load(filename);
+    return mapping.LoadString(defaultmapping);
+}
 
-    // Init stuff related to being a pretend desk (just to show button functionality)
-    for(i=0;i<64;i++) {
-        channels[i].mainlevel=0;
-        channels[i].mute=1;
-        channels[i].trimlevel=10;
-        channels[i].pan=0;
-        channels[i].solo=0;
-        channels[i].rec=0;
-        channels[i].pad.Colour=WHITE;
-        channels[i].pad.Inverted=0;
-        channels[i].mode=0;
-        sprintf(channels[i].pad.TopText," ");
-        sprintf(channels[i].pad.BotText,"Ch %d",i+1);        
+int main(int argc, char **argv) {
+    int i;
+    int timeout;
+    int delay;
+    const char *mapfile=NULL;
+    const char *transportspec="udp:10111";
+    const char *shmname=NULL;
+    const char *tracefile=NULL;
+    unsigned int bytespersec=64000;
+    unsigned int packetspersec=800;
+    char name[XT_CH_NAME_LEN];
+    struct sigaction sa;
+    XTouchTransport *transport;
+
+    while ((i=getopt(argc, argv, "m:t:b:n:s:a:T:"))!=-1) {
+        switch (i) {
+            case 'm': mapfile=optarg; break;
+            case 't': transportspec=optarg; break;
+            case 'b': bytespersec=atoi(optarg); break;
+            case 'n': packetspersec=atoi(optarg); break;
+            case 's': shmname=optarg; break;
+            case 'a': autofile=optarg; break;
+            case 'T': tracefile=optarg; break;
+            default:
+                    fprintf(stderr,"Usage: %s [-m mappingfile] [-t transport] [-b bytespersec] [-n packetspersec] [-s /shmname] [-a automationfile] [-T tracefile]\n",argv[0]);
+                    fprintf(stderr,"Transports: udp[:port], tcp:host:port, file:path, stdio\n");
+                    exit(1);
+        }
     }
 
-    XTouch FaderBoard(sendpacket,(void*)&udpsocket);
+    // ------------------------------------------------------------------------------------
+    // Open the connection to the X-Touch - normally UDP port 10111
+    transport = XTouchTransport::Open(transportspec);
+    if (!transport) exit(1);
+    // ------------------------------------------------------------------------------------
+
+    // Output is paced so a full refresh can't swamp the X-Touch, with interactive updates going first
+    XTouchScheduler Scheduler(XTouchTransport::SendHandler,(void*)transport);
+    Scheduler.SetRate(bytespersec,packetspersec);
 
+    XTouch FaderBoard(XTouchScheduler::SendHandler,(void*)&Scheduler);
+    Scheduler.RegisterDropCallback(XTouch::RefreshHandler,(void*)&FaderBoard);
+    scribble=new XTouchScribble(&FaderBoard);
+    leds=new XTouchLeds(&FaderBoard);
+    surface=new XTouchSurface(&FaderBoard,&Scheduler);
+    transport->RegisterReceiveCallback(packetreceived,(void*)&FaderBoard);
     FaderBoard.RegisterButtonCallback(buttonpressed, (void*)&FaderBoard);
     FaderBoard.RegisterFaderCallback(faderlevel,(void*)&FaderBoard);
     FaderBoard.RegisterFaderStateCallback(fadertouch,(void*)&FaderBoard);
     FaderBoard.RegisterDialCallback(dial,(void*)&FaderBoard);
 
+    // Other processes can follow the surface state in shared memory (see x-touch-shm.h)
+    if (shmname) {
+        publisher=XTouchShmPublisher::Create(shmname);
+        if (!publisher) exit(1);
+        FaderBoard.SetPublisher(publisher);
+    }
+
+    // Latency from each packet received to the packets sent in response, as a Chrome trace
+    // (open in https://ui.perfetto.dev). Interrupt to finish it
+    if (tracefile) {
+        trace=XTouchTrace::Open(tracefile);
+        if (!trace) exit(1);
+        transport->SetTrace(trace);
+        FaderBoard.SetTrace(trace);
+        Scheduler.SetTrace(trace);
+        atexit(FinishTrace);
+    }
+
+    // Surface behaviour comes from the mapping. Send SIGHUP to reload the mapping file
+    mapping.DefineParam("rec", PARAM_REC);
+    mapping.DefineParam("solo", PARAM_SOLO);
+    mapping.DefineParam("mute", PARAM_MUTE);
+    mapping.DefineParam("select", PARAM_SELECT);
+    mapping.DefineParam("mode", PARAM_MODE);
+    mapping.DefineParam("adjust", PARAM_ADJUST);
+    mapping.DefineParam("level", PARAM_LEVEL);
+    mapping.DefineParam("master", PARAM_MASTER);
+    mapping.DefineParam("jog", PARAM_JOG);
+    mapping.DefineParam("automode", PARAM_AUTOMODE);
+    mapping.DefineParam("autogroup", PARAM_AUTOGROUP);
+    mapping.DefineParam("transport", PARAM_TRANSPORT);
+    mapping.SetFixedBankSize(8);
+    if (!LoadMapping(mapfile)) exit(1);
+
+    // Init stuff related to being a pretend desk (just to show button functionality)
+    // The desk is sized by the mapping - reloads can't then address channels beyond it
+    channels=new XTouchChannelStore(mapping.BankCount()*mapping.BankSize(),mapping.BankSize());
+    mapping.SetChannelLimit(channels->Channels());
+    for(i=0;i<channels->Channels();i++) {
+        snprintf(name,sizeof(name),"Channel %d",i+1);
+        channels->SetMute(i,1);
+        channels->SetTrim(i,10);
+        channels->SetName(i,name);
+    }
+
+    // Fader automation for every channel, kept in the file given with -a
+    automation=new XTouchAutomation(channels->Channels());
+    automation->RegisterOutputCallback(automationlevel,(void*)&FaderBoard);
+    if ((autofile)&&(access(autofile,F_OK)==0)&&(!automation->Load(autofile))) exit(1);
+    mapping.RegisterParamCallback(parameterchanged,(void*)&FaderBoard);
+    mapping.RegisterBankCallback(bankchanged,(void*)&FaderBoard);
+
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = hangup;
+    sigaction(SIGHUP, &sa, NULL);
+    if (trace) {
+        sa.sa_handler = interrupted;
+        sigaction(SIGINT, &sa, NULL);
+        sigaction(SIGTERM, &sa, NULL);
+    }
+
     RenderPage(&FaderBoard);
 
+    // Each fader is followed by a task of its own
+    for(i=0;i<8;i++) {
+        surface->Spawn(FollowFader(*surface,i));
+    }
+    surface->Spawn(FollowMaster(*surface));
+    surface->Run();
+
     // The main packet processing loop
     while (1) {
-
-        memset(recvbuf, 0, BUFSIZE);
-        recvlen = recvfrom(udpsocket.sockfd, recvbuf, BUFSIZE, 0, (struct sockaddr *) &(udpsocket.clientaddr), &(udpsocket.clientlen));
-        if (recvlen < 0) {
-            perror("ERROR in recvfrom");
-            exit(1);
+        // Anything sent from here on isn't in response to a packet
+        if (trace) trace->Idle();
+        timeout=TickScribble();
+        delay=TickLeds();
+        if (delay<timeout) timeout=delay;
+        delay=automation->Tick();
+        if ((delay>=0)&&(delay<timeout)) timeout=delay;
+        Render(&FaderBoard);
+        leds->Update();
+        delay=Scheduler.NextDelay();
+        if ((delay>=0)&&(delay<timeout)) timeout=delay;
+        if (transport->Poll(timeout) < 0) {
+            if (errno==0) {
+                printf("Connection closed\n");
+                exit(0);
+            }
+            if (errno!=EINTR) {
+                perror("ERROR receiving");
+                exit(1);
+            }
+        }
+        if (quit) exit(0);
+        Scheduler.Pump();
+        surface->Run();
+        if (reloadmapping) {
+            // Swapped in between packets, so nothing is lost whilst reloading
+            reloadmapping=0;
+            if (mapfile&&LoadMapping(mapfile)) {
+                printf("Reloaded %s\n",mapfile);
+                RenderPage(&FaderBoard);
+                // The select buttons flash twice to show it's been reloaded
+                leds->Pattern(24,31,XT_LED_ATTENTION,XT_LED_ATTENTION_STEPS,2,2*XT_LED_ATTENTION_STEPS);
+            }
         }
-
-        now = time(0);
-        localtm = localtime(&now);
-        FaderBoard.SetTime(localtm);
-        FaderBoard.HandlePacket(recvbuf,recvlen);
     }
 }
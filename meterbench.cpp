@@ -0,0 +1,360 @@
+/* ------------------------------------------------------------------------------
+   Meter test and benchmark for the x-touch library.
+   Runs a WAV file through the metering kernels to show the levels the
+   X-Touch's meters would show and check every kernel gets the same answer,
+   or measures how fast each kernel is in channels x samples per second.
+   -----------------------------------------------------------------------------*/
+
+/*
+MIT License
+
+Copyright (c) 2020 Martin Whitaker
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+/* Usage:
+     x-touch-meterbench [-k kernel] [-p period_ms] file.wav
+        Prints the peak and RMS level of each channel and the 0-9 meter level for
+        them, checking every kernel agrees. With -p the meter levels are also
+        printed for every period of the file, as they would be sent to the X-Touch.
+     x-touch-meterbench -B [-c channels] [-f frames]
+        Times every kernel on interleaved and planar buffers of the given size.
+
+   WAV files can be 16, 24 or 32 bit PCM or 32 bit float, with up to 64 channels.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <math.h>
+#include <time.h>
+
+#include "x-touch-meter.h"
+
+static const xt_meter_kernel_t Kernels[] = { XT_METER_SCALAR, XT_METER_SSE, XT_METER_AVX2 };
+
+static unsigned int ReadLE(const unsigned char *p, int bytes) {
+    unsigned int v=0;
+    int i;
+    for(i=bytes-1;i>=0;i--) {
+        v=(v<<8)|p[i];
+    }
+    return v;
+}
+
+// Returns the samples of a WAV file as interleaved floats, or NULL on error
+float *LoadWav(const char *filename, int *channels, int *rate, int *frames) {
+    FILE *f;
+    unsigned char *file;
+    unsigned char *fmt=NULL;
+    unsigned char *data=NULL;
+    unsigned int datalen=0;
+    unsigned int chunklen;
+    long len;
+    long pos;
+    int format;
+    int bits;
+    int bytes;
+    long i;
+    long n;
+    float *samples;
+    unsigned int v;
+
+    f=fopen(filename,"rb");
+    if (!f) {
+        perror(filename);
+        return NULL;
+    }
+    fseek(f,0,SEEK_END);
+    len=ftell(f);
+    fseek(f,0,SEEK_SET);
+    file=(unsigned char*)malloc(len>0?len:1);
+    if ((len<12)||(fread(file,1,len,f)!=(size_t)len)||(memcmp(file,"RIFF",4)!=0)||(memcmp(file+8,"WAVE",4)!=0)) {
+        printf("%s is not a WAV file\n",filename);
+        fclose(f);
+        free(file);
+        return NULL;
+    }
+    fclose(f);
+
+    for(pos=12;pos+8<=len;pos+=8+chunklen+(chunklen&1)) {
+        chunklen=ReadLE(file+pos+4,4);
+        if (chunklen>len-pos-8) chunklen=len-pos-8;     // Truncated file
+        if ((memcmp(file+pos,"fmt ",4)==0)&&(chunklen>=16)) fmt=file+pos+8;
+        if (memcmp(file+pos,"data",4)==0) {
+            data=file+pos+8;
+            datalen=chunklen;
+        }
+    }
+    if ((!fmt)||(!data)) {
+        printf("%s has no %s chunk\n",filename,fmt?"data":"fmt");
+        free(file);
+        return NULL;
+    }
+    format=ReadLE(fmt,2);
+    *channels=ReadLE(fmt+2,2);
+    *rate=ReadLE(fmt+4,4);
+    bits=ReadLE(fmt+14,2);
+    if (format==0xfffe) format=ReadLE(fmt+24,2);        // WAVE_FORMAT_EXTENSIBLE sub-format
+    bytes=bits/8;
+    if ((*channels<1)||(*channels>XT_METER_MAX_CHANNELS)||
+        !(((format==1)&&((bits==16)||(bits==24)||(bits==32)))||((format==3)&&(bits==32)))) {
+        printf("%s: unsupported format %d, %d bits, %d channels\n",filename,format,bits,*channels);
+        free(file);
+        return NULL;
+    }
+
+    *frames=datalen/(bytes**channels);
+    n=(long)*frames**channels;
+    samples=(float*)malloc((n>0?n:1)*sizeof(float));
+    for(i=0;i<n;i++) {
+        v=ReadLE(data+i*bytes,bytes);
+        if (format==3) {
+            memcpy(&samples[i],&v,4);
+        } else {
+            v<<=32-bits;                                // Sign extend via the top bit
+            samples[i]=(int)v/2147483648.0f;
+        }
+    }
+    free(file);
+    return samples;
+}
+
+void Deinterleave(const float *samples, int frames, int channels, float **planes) {
+    int i;
+    int ch;
+    for(i=0;i<frames;i++) {
+        for(ch=0;ch<channels;ch++) {
+            planes[ch][i]=samples[(long)i*channels+ch];
+        }
+    }
+}
+
+int RunFile(const char *filename, xt_meter_kernel_t kernel, int period) {
+    float *samples;
+    float *planes[XT_METER_MAX_CHANNELS];
+    int channels;
+    int rate;
+    int frames;
+    int periodframes;
+    int i;
+    int k;
+    int ch;
+    int planar;
+    int errors=0;
+    float rms;
+
+    samples=LoadWav(filename,&channels,&rate,&frames);
+    if (!samples) return 0;
+    printf("%s: %d channels, %dHz, %d frames\n",filename,channels,rate,frames);
+
+    XTouchMeter reference(channels);
+    reference.SetKernel(XT_METER_SCALAR);
+    reference.Analyse(samples,frames);
+
+    // Every kernel, both ways round, should get the scalar kernel's answer
+    for(ch=0;ch<channels;ch++) {
+        planes[ch]=(float*)malloc((frames>0?frames:1)*sizeof(float));
+    }
+    Deinterleave(samples,frames,channels,planes);
+    for(k=0;k<3;k++) {
+        XTouchMeter meter(channels);
+        if (meter.SetKernel(Kernels[k])!=Kernels[k]) {
+            printf("%-6s not supported by this CPU\n",XTouchMeter::KernelName(Kernels[k]));
+            continue;
+        }
+        for(planar=0;planar<2;planar++) {
+            meter.Reset();
+            if (planar) {
+                meter.AnalysePlanar(planes,frames);
+            } else {
+                meter.Analyse(samples,frames);
+            }
+            for(ch=0;ch<channels;ch++) {
+                rms=reference.Rms(ch);
+                if ((meter.Peak(ch)!=reference.Peak(ch))||(fabsf(meter.Rms(ch)-rms)>rms*1e-4f+1e-9f)) {
+                    printf("%-6s %s channel %d: peak %g rms %g, expected %g %g\n",XTouchMeter::KernelName(Kernels[k]),
+                           planar?"planar":"interleaved",ch+1,meter.Peak(ch),meter.Rms(ch),reference.Peak(ch),rms);
+                    errors++;
+                }
+            }
+        }
+    }
+
+    XTouchMeter meter(channels);
+    kernel=meter.SetKernel(kernel);
+    meter.Analyse(samples,frames);
+    printf("Channel   Peak dB  Meter    RMS dB  Meter   (%s kernel)\n",XTouchMeter::KernelName(kernel));
+    for(ch=0;ch<channels;ch++) {
+        printf("%7d  %8.2f  %5d  %8.2f  %5d\n",ch+1,XTouchMeter::ToDb(meter.Peak(ch)),meter.Level(ch),
+               XTouchMeter::ToDb(meter.Rms(ch)),meter.Level(ch,1));
+    }
+
+    // The peak meter levels as they would be sent every period
+    if (period>0) {
+        periodframes=(long)rate*period/1000;
+        if (periodframes<1) periodframes=1;
+        for(i=0;i<frames;i+=periodframes) {
+            meter.Reset();
+            meter.Analyse(samples+(long)i*channels,(frames-i<periodframes)?frames-i:periodframes);
+            printf("%8.3fs ",(double)i/rate);
+            for(ch=0;ch<channels;ch++) {
+                printf(" %d",meter.Level(ch));
+            }
+            printf("\n");
+        }
+    }
+
+    for(ch=0;ch<channels;ch++) {
+        free(planes[ch]);
+    }
+    free(samples);
+    if (errors) printf("%d mismatches between kernels\n",errors);
+    return errors==0;
+}
+
+static double Now() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC,&ts);
+    return ts.tv_sec+ts.tv_nsec/1e9;
+}
+
+// Analyses the same buffer over and over for about 0.2s, returning channels x samples per second
+double Time(XTouchMeter *meter, const float *samples, float **planes, int frames, int planar) {
+    double start;
+    double elapsed;
+    long runs=0;
+    int i;
+
+    start=Now();
+    do {
+        for(i=0;i<64;i++) {
+            if (planar) {
+                meter->AnalysePlanar(planes,frames);
+            } else {
+                meter->Analyse(samples,frames);
+            }
+        }
+        runs+=64;
+        elapsed=Now()-start;
+    } while (elapsed<0.2);
+    return (double)runs*frames*meter->Channels()/elapsed;
+}
+
+void Benchmark(int onlychannels, int frames) {
+    static const int ChannelCounts[] = { 1, 2, 6, 8, 16, 32, 64 };
+    float *samples;
+    float *planes[XT_METER_MAX_CHANNELS];
+    int channels;
+    int c;
+    int k;
+    int ch;
+    long i;
+
+    printf("Million channel-samples per second, %d frame buffers\n",frames);
+    printf("Channels    Layout");
+    for(k=0;k<3;k++) {
+        printf("  %10s",XTouchMeter::KernelName(Kernels[k]));
+    }
+    printf("\n");
+
+    for(c=0;c<(int)(sizeof(ChannelCounts)/sizeof(ChannelCounts[0]));c++) {
+        channels=onlychannels?onlychannels:ChannelCounts[c];
+        samples=(float*)malloc((long)frames*channels*sizeof(float));
+        for(i=0;i<(long)frames*channels;i++) {
+            samples[i]=sinf(i*0.001f)*0.5f;
+        }
+        for(ch=0;ch<channels;ch++) {
+            planes[ch]=(float*)malloc(frames*sizeof(float));
+        }
+        Deinterleave(samples,frames,channels,planes);
+
+        XTouchMeter meter(channels);
+        printf("%8d  interleaved",channels);
+        for(k=0;k<3;k++) {
+            if (meter.SetKernel(Kernels[k])!=Kernels[k]) {
+                printf("  %10s","-");
+            } else {
+                printf("  %10.1f",Time(&meter,samples,planes,frames,0)/1e6);
+            }
+        }
+        printf("\n%8d       planar",channels);
+        for(k=0;k<3;k++) {
+            if (meter.SetKernel(Kernels[k])!=Kernels[k]) {
+                printf("  %10s","-");
+            } else {
+                printf("  %10.1f",Time(&meter,samples,planes,frames,1)/1e6);
+            }
+        }
+        printf("\n");
+
+        for(ch=0;ch<channels;ch++) {
+            free(planes[ch]);
+        }
+        free(samples);
+        if (onlychannels) break;
+    }
+}
+
+int main(int argc, char **argv) {
+    xt_meter_kernel_t kernel=XT_METER_AUTO;
+    int benchmark=0;
+    int channels=0;
+    int frames=512;
+    int period=0;
+    int i;
+
+    while ((i=getopt(argc, argv, "k:p:Bc:f:"))!=-1) {
+        switch (i) {
+            case 'k':
+                    for(kernel=XT_METER_AUTO;kernel<=XT_METER_AVX2;kernel=(xt_meter_kernel_t)(kernel+1)) {
+                        if (strcmp(optarg,XTouchMeter::KernelName(kernel))==0) break;
+                    }
+                    if (kernel>XT_METER_AVX2) {
+                        fprintf(stderr,"Unknown kernel %s - use auto, scalar, sse or avx2\n",optarg);
+                        exit(1);
+                    }
+                    break;
+            case 'p': period=atoi(optarg); break;
+            case 'B': benchmark=1; break;
+            case 'c': channels=atoi(optarg); break;
+            case 'f': frames=atoi(optarg); break;
+            default:
+                    fprintf(stderr,"Usage: %s [-k kernel] [-p period_ms] file.wav\n",argv[0]);
+                    fprintf(stderr,"       %s -B [-c channels] [-f frames]\n",argv[0]);
+                    exit(1);
+        }
+    }
+
+    if (benchmark) {
+        if ((channels<0)||(channels>XT_METER_MAX_CHANNELS)||(frames<1)) {
+            fprintf(stderr,"Channels must be 1 to %d and frames at least 1\n",XT_METER_MAX_CHANNELS);
+            exit(1);
+        }
+        Benchmark(channels,frames);
+        exit(0);
+    }
+    if (optind>=argc) {
+        fprintf(stderr,"Usage: %s [-k kernel] [-p period_ms] file.wav\n",argv[0]);
+        exit(1);
+    }
+    exit(RunFile(argv[optind],kernel,period)?0:1);
+}
@@ -0,0 +1,322 @@
+/* ------------------------------------------------------------------------------
+   OSC bridge for the x-touch library.
+   Publishes every button, fader and dial event from the X-Touch as an OSC
+   message, and accepts OSC messages to drive the faders, lights, scribble
+   pads, meters and 7-segment displays. Messages sent in an OSC bundle are
+   packed into as few Xctl packets as possible.
+   -----------------------------------------------------------------------------*/
+
+/*
+MIT License
+
+Copyright (c) 2020 Martin Whitaker
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+/* Messages sent by the bridge (to the -c port and to every subscriber):
+     /xtouch/button  ii   button, 1=pressed 0=released
+     /xtouch/fader   ii   fader (0-8), level (0-16383)
+     /xtouch/touch   ii   fader (0-8), 1=touched 0=released
+     /xtouch/dial    ii   dial, clicks (negative = anti-clockwise)
+
+   Messages accepted by the bridge (on the -p port, localhost only).
+   Integer arguments may also be sent as floats:
+     /xtouch/subscribe          also send events to the sender of this message
+     /xtouch/fader       ii     fader (0-8), level (0-16383)
+     /xtouch/fader/db    if     fader (0-8), dB (-200 for off), using the console fader law
+     /xtouch/button      ii     button (0-115), 0=off 1=flashing 2=on
+     /xtouch/meter       ii     channel (0-7), level (0-9)
+     /xtouch/meters      i...   up to 8 levels, starting at channel 0
+     /xtouch/dial/pan    ii     channel (0-7), position (-6 to 6)
+     /xtouch/dial/level  ii     channel (0-7), level (0-13)
+     /xtouch/scribble    iss[ii] channel (0-7), top text, bottom text, [colour (0-7)], [inverted]
+     /xtouch/assignment  i      -9 to 99
+     /xtouch/frames      i      -99 to 999
+     /xtouch/hmsf        iiii   hours, minutes, seconds, frames
+     /xtouch/segments    is     first digit (0-11), text
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include "x-touch.h"
+#include "x-touch-osc.h"
+#include "x-touch-transport.h"
+#include "x-touch-scheduler.h"
+#include "x-touch-fader.h"
+
+#define OSCBUFSIZE 65536
+#define MAXSUBSCRIBERS 8
+
+typedef struct {
+    int sockfd;
+    struct sockaddr_in replyaddr;       // Sender of the message being handled
+    struct sockaddr_in subscribers[MAXSUBSCRIBERS];
+    int subscribercount;
+    XTouch *board;
+    XTouchFaderLaw *law;
+} oscinfo_t;
+
+void packetreceived(void *data, unsigned char *buffer, unsigned int len) {
+    ((XTouch*)data)->HandlePacket(buffer,len);
+}
+
+void sendevent(oscinfo_t *osc, const char *address, int id, int value) {
+    unsigned char buffer[64];
+    unsigned int len;
+    int i;
+    len=XTouchOsc::Build(buffer,sizeof(buffer),address,"ii",id,value);
+    for(i=0;i<osc->subscribercount;i++) {
+        sendto(osc->sockfd, buffer, len, 0, (struct sockaddr *) &(osc->subscribers[i]), sizeof(struct sockaddr_in));
+    }
+}
+
+void buttonpressed(void *data, unsigned char button, int value) {
+    sendevent((oscinfo_t *)data,"/xtouch/button",button,value);
+}
+
+// Fader moves are sent as both the position and dB
+void faderlevel(void *data, unsigned char fader, int value) {
+    oscinfo_t *osc=(oscinfo_t *)data;
+    unsigned char buffer[64];
+    unsigned int len;
+    int i;
+    sendevent(osc,"/xtouch/fader",fader,value);
+    len=XTouchOsc::Build(buffer,sizeof(buffer),"/xtouch/fader/db","if",fader,osc->law->PositionToDb(value));
+    for(i=0;i<osc->subscribercount;i++) {
+        sendto(osc->sockfd, buffer, len, 0, (struct sockaddr *) &(osc->subscribers[i]), sizeof(struct sockaddr_in));
+    }
+}
+
+void fadertouch(void *data, unsigned char fader, int value) {
+    sendevent((oscinfo_t *)data,"/xtouch/touch",fader,value);
+}
+
+void dial(void *data, unsigned char dial, int value) {
+    sendevent((oscinfo_t *)data,"/xtouch/dial",dial,value);
+}
+
+void subscribe(oscinfo_t *osc, struct sockaddr_in *addr) {
+    int i;
+    for(i=0;i<osc->subscribercount;i++) {
+        if ((osc->subscribers[i].sin_addr.s_addr==addr->sin_addr.s_addr)&&(osc->subscribers[i].sin_port==addr->sin_port)) return;
+    }
+    if (osc->subscribercount==MAXSUBSCRIBERS) {
+        printf("Too many subscribers\n");
+        return;
+    }
+    osc->subscribers[osc->subscribercount++]=*addr;
+    printf("Subscriber added: %s:%d\n",inet_ntoa(addr->sin_addr),ntohs(addr->sin_port));
+}
+
+// Each OSC bundle becomes one XTouch batch
+void bundle(void *data, unsigned char depth, int start) {
+    oscinfo_t *osc=(oscinfo_t *)data;
+    if (start) {
+        osc->board->BeginBatch();
+    } else {
+        osc->board->EndBatch();
+    }
+}
+
+void oscmessage(void *data, xt_osc_message_t *msg) {
+    oscinfo_t *osc=(oscinfo_t *)data;
+    XTouch *board=osc->board;
+    xt_ScribblePad_t pad;
+    const char *top;
+    const char *bottom;
+    const char *cmd;
+    char text[13];
+    int a, b, c, d;
+    float f;
+
+    if (strncmp(msg->Address,"/xtouch/",8)!=0) return;
+    cmd=msg->Address+8;
+
+    if (strcmp(cmd,"subscribe")==0) {
+        subscribe(osc,&osc->replyaddr);
+    } else if (strcmp(cmd,"fader")==0) {
+        if (XTouchOsc::ReadInt(msg,&a)&&XTouchOsc::ReadInt(msg,&b)) board->SetFaderLevel(a,b);
+    } else if (strcmp(cmd,"fader/db")==0) {
+        if (XTouchOsc::ReadInt(msg,&a)&&XTouchOsc::ReadFloat(msg,&f)) board->SetFaderLevel(a,osc->law->DbToPosition(f));
+    } else if (strcmp(cmd,"button")==0) {
+        if (XTouchOsc::ReadInt(msg,&a)&&XTouchOsc::ReadInt(msg,&b)&&(a>=0)&&(a<=115)&&(b>=OFF)&&(b<=ON)) board->SetSingleButton(a,(xt_button_state_t)b);
+    } else if (strcmp(cmd,"meter")==0) {
+        if (XTouchOsc::ReadInt(msg,&a)&&XTouchOsc::ReadInt(msg,&b)) board->SetMeterLevel(a,b);
+    } else if (strcmp(cmd,"meters")==0) {
+        board->BeginBatch();
+        for(a=0;(a<8)&&XTouchOsc::ReadInt(msg,&b);a++) {
+            board->SetMeterLevel(a,b);
+        }
+        board->EndBatch();
+    } else if (strcmp(cmd,"dial/pan")==0) {
+        if (XTouchOsc::ReadInt(msg,&a)&&XTouchOsc::ReadInt(msg,&b)) board->SetDialPan(a,b);
+    } else if (strcmp(cmd,"dial/level")==0) {
+        if (XTouchOsc::ReadInt(msg,&a)&&XTouchOsc::ReadInt(msg,&b)) board->SetDialLevel(a,b);
+    } else if (strcmp(cmd,"scribble")==0) {
+        if (XTouchOsc::ReadInt(msg,&a)&&XTouchOsc::ReadString(msg,&top)&&XTouchOsc::ReadString(msg,&bottom)) {
+            memset(&pad,0,sizeof(pad));
+            strncpy(pad.TopText,top,7);
+            strncpy(pad.BotText,bottom,7);
+            pad.Colour=WHITE;
+            if (XTouchOsc::ReadInt(msg,&b)&&(b>=BLACK)&&(b<=WHITE)) pad.Colour=(xt_colours_t)b;
+            if (XTouchOsc::ReadInt(msg,&c)) pad.Inverted=c;
+            board->SetScribble(a,pad);
+        }
+    } else if (strcmp(cmd,"assignment")==0) {
+        if (XTouchOsc::ReadInt(msg,&a)) board->SetAssignment(a);
+    } else if (strcmp(cmd,"frames")==0) {
+        if (XTouchOsc::ReadInt(msg,&a)) board->SetFrames(a);
+    } else if (strcmp(cmd,"hmsf")==0) {
+        if (XTouchOsc::ReadInt(msg,&a)&&XTouchOsc::ReadInt(msg,&b)&&XTouchOsc::ReadInt(msg,&c)&&XTouchOsc::ReadInt(msg,&d)) board->SetHMSF(a,b,c,d);
+    } else if (strcmp(cmd,"segments")==0) {
+        if (XTouchOsc::ReadInt(msg,&a)&&XTouchOsc::ReadString(msg,&top)) {
+            strncpy(text,top,12);
+            text[12]=0;
+            board->SetSegmentText(a,text);
+        }
+    }
+}
+
+int openudp(unsigned long addr, int port) {
+    struct sockaddr_in serveraddr;
+    int sockfd;
+    int optval;
+
+    sockfd = socket(AF_INET, SOCK_DGRAM, 0);
+    if (sockfd < 0) {
+        perror("ERROR opening socket");
+        exit(1);
+    }
+
+    optval = 1;
+    setsockopt(sockfd, SOL_SOCKET, SO_REUSEADDR, (const void *)&optval , sizeof(int));
+
+    memset(&serveraddr, 0, sizeof(serveraddr));
+    serveraddr.sin_family = AF_INET;
+    serveraddr.sin_addr.s_addr = htonl(addr);
+    serveraddr.sin_port = htons((unsigned short)port);
+
+    if (bind(sockfd, (struct sockaddr *) &serveraddr, sizeof(serveraddr)) < 0) {
+        perror("ERROR on binding");
+        exit(1);
+    }
+    return sockfd;
+}
+
+int main(int argc, char **argv) {
+    static unsigned char oscbuf[OSCBUFSIZE];
+    struct pollfd fds[2];
+    socklen_t addrlen;
+    int recvlen;
+    int oscport=9000;
+    int clientport=9001;
+    const char *transportspec="udp:10111";
+    unsigned int bytespersec=64000;
+    unsigned int packetspersec=800;
+    int i;
+
+    XTouchTransport *transport;
+    oscinfo_t osc;
+
+    while ((i=getopt(argc, argv, "p:c:t:b:n:"))!=-1) {
+        switch (i) {
+            case 'p': oscport=atoi(optarg); break;
+            case 'c': clientport=atoi(optarg); break;
+            case 't': transportspec=optarg; break;
+            case 'b': bytespersec=atoi(optarg); break;
+            case 'n': packetspersec=atoi(optarg); break;
+            default:
+                    fprintf(stderr,"Usage: %s [-p oscport] [-c clientport] [-t transport] [-b bytespersec] [-n packetspersec]\n",argv[0]);
+                    exit(1);
+        }
+    }
+
+    transport = XTouchTransport::Open(transportspec);
+    if (!transport) exit(1);
+
+    memset(&osc, 0, sizeof(osc));
+    osc.sockfd = openudp(INADDR_LOOPBACK, oscport);
+    osc.subscribers[0].sin_family = AF_INET;
+    osc.subscribers[0].sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    osc.subscribers[0].sin_port = htons((unsigned short)clientport);
+    osc.subscribercount = 1;
+
+    XTouchScheduler Scheduler(XTouchTransport::SendHandler,(void*)transport);
+    Scheduler.SetRate(bytespersec,packetspersec);
+
+    XTouch FaderBoard(XTouchScheduler::SendHandler,(void*)&Scheduler);
+    Scheduler.RegisterDropCallback(XTouch::RefreshHandler,(void*)&FaderBoard);
+    transport->RegisterReceiveCallback(packetreceived,(void*)&FaderBoard);
+    osc.board = &FaderBoard;
+    osc.law = new XTouchFaderLaw(XT_TAPER_CONSOLE);
+
+    FaderBoard.RegisterButtonCallback(buttonpressed, (void*)&osc);
+    FaderBoard.RegisterFaderCallback(faderlevel,(void*)&osc);
+    FaderBoard.RegisterFaderStateCallback(fadertouch,(void*)&osc);
+    FaderBoard.RegisterDialCallback(dial,(void*)&osc);
+
+    XTouchOsc Parser;
+    Parser.RegisterMessageCallback(oscmessage,(void*)&osc);
+    Parser.RegisterBundleCallback(bundle,(void*)&osc);
+
+    printf("Listening for OSC on port %d, sending events to port %d\n",oscport,clientport);
+
+    fds[0].fd = transport->Fd();
+    fds[0].events = POLLIN;
+    fds[1].fd = osc.sockfd;
+    fds[1].events = POLLIN;
+
+    while (1) {
+        if (poll(fds, 2, Scheduler.NextDelay()) < 0) {
+            if (errno==EINTR) continue;
+            perror("ERROR in poll");
+            exit(1);
+        }
+
+        if (fds[0].revents & (POLLIN|POLLHUP|POLLERR)) {
+            if ((transport->Poll(0) < 0) && (errno != EINTR)) {
+                printf("Connection to the X-Touch lost\n");
+                exit(1);
+            }
+        }
+
+        // Drain every waiting OSC packet before going back to poll
+        if (fds[1].revents & POLLIN) {
+            while (1) {
+                addrlen = sizeof(osc.replyaddr);
+                recvlen = recvfrom(osc.sockfd, oscbuf, OSCBUFSIZE, MSG_DONTWAIT, (struct sockaddr *) &(osc.replyaddr), &addrlen);
+                if (recvlen <= 0) break;
+                if (Parser.HandlePacket(oscbuf,recvlen) < 0) {
+                    printf("Malformed OSC packet - length %d\n",recvlen);
+                }
+            }
+        }
+
+        Scheduler.Pump();
+    }
+}
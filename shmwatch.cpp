@@ -0,0 +1,115 @@
+/* ------------------------------------------------------------------------------
+   Shared state watcher for the x-touch library.
+   Follows the state block published by an application (e.g. x-touch-test -s)
+   from another process and prints what changes, as an example of a reader.
+   -----------------------------------------------------------------------------*/
+
+
+/*
+MIT License
+
+Copyright (c) 2020 Martin Whitaker
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+/* Usage:
+     x-touch-watch [-i ms] [/shmname]
+        Polls the block (default /x-touch) every ms milliseconds (default 10) and prints
+        every fader, touch, button, light, meter, selection and bank change. Polls where
+        nothing has changed don't copy anything.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <signal.h>
+#include <errno.h>
+#include <time.h>
+
+#include "x-touch-shm.h"
+
+void PrintChanges(xt_shm_state_t *last, xt_shm_state_t *now) {
+    int i;
+    int pressed;
+
+    for(i=0;i<9;i++) {
+        if (now->Faders[i]!=last->Faders[i]) printf("Fader %d at %d\n",i,now->Faders[i]);
+        if ((now->Touched^last->Touched)&(1u<<i)) printf("Fader %d %s\n",i,(now->Touched&(1u<<i))?"touched":"released");
+    }
+    for(i=0;i<128;i++) {
+        pressed=(now->Pressed[i>>5]>>(i&31))&1;
+        if (pressed!=(int)((last->Pressed[i>>5]>>(i&31))&1)) printf("Button %d %s\n",i,pressed?"pressed":"released");
+        if (now->Lights[i]!=last->Lights[i]) printf("Light %d %s\n",i,(now->Lights[i]==2)?"on":(now->Lights[i]==1)?"flashing":"off");
+    }
+    for(i=0;i<8;i++) {
+        if (now->Meters[i]!=last->Meters[i]) printf("Meter %d at %d\n",i,now->Meters[i]);
+    }
+    if (now->Selected!=last->Selected) printf("Channel %d selected\n",now->Selected+1);
+    if (now->Bank!=last->Bank) printf("Bank %d\n",now->Bank+1);
+}
+
+int main(int argc, char **argv) {
+    int i;
+    int interval=10;
+    const char *name="/x-touch";
+    uint64_t changes=0;
+    uint64_t lastchanges=0;
+    xt_shm_state_t last;
+    xt_shm_state_t now;
+    XTouchShmReader *reader;
+
+    while ((i=getopt(argc, argv, "i:"))!=-1) {
+        switch (i) {
+            case 'i': interval=atoi(optarg); break;
+            default:
+                    fprintf(stderr,"Usage: %s [-i ms] [/shmname]\n",argv[0]);
+                    exit(1);
+        }
+    }
+    if (optind<argc) name=argv[optind];
+    if (interval<1) interval=1;
+
+    reader=XTouchShmReader::Open(name);
+    if (!reader) exit(1);
+    if (!reader->Read(&last,&lastchanges)) {
+        printf("Couldn't read %s\n",name);
+        exit(1);
+    }
+    printf("Following %s written by process %d\n",name,reader->WriterPid());
+    changes=lastchanges;
+
+    while (1) {
+        usleep(interval*1000);
+        if (!reader->ReadIfChanged(&now,&changes)) {
+            // The writer only goes away without updating the block, so check it's still there
+            if ((kill(reader->WriterPid(),0)<0)&&(errno==ESRCH)) break;
+            continue;
+        }
+        if (changes-lastchanges>1) printf("(%llu states)\n",(unsigned long long)(changes-lastchanges));
+        PrintChanges(&last,&now);
+        fflush(stdout);
+        last=now;
+        lastchanges=changes;
+    }
+    printf("Process %d has gone\n",reader->WriterPid());
+    delete reader;
+    return 0;
+}
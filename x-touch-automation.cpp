@@ -0,0 +1,572 @@
+/* ----------------------------------------------------------------
+                   x-touch-xctl library - fader automation.
+   Records fader moves per channel against a transport clock and
+   plays them back to the motor faders, with the usual read, touch,
+   latch and write modes. Lanes can be saved to a file that is
+   mapped straight back into memory when loaded.
+   ---------------------------------------------------------------- */
+
+
+/*
+MIT License
+
+Copyright (c) 2020 Martin Whitaker
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#include "x-touch-automation.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#define XT_AUTO_POINT_BYTES 10      // Most an encoded point can take
+
+// ----------------------------------------------------------------------------------------------
+// Public interfaces
+// ----------------------------------------------------------------------------------------------
+
+XTouchAutomation::XTouchAutomation(int lanes) {
+    int i;
+    if (lanes<1) lanes=1;
+    mLaneCount=lanes;
+    mLanes=(xt_auto_lane_t *)calloc(lanes,sizeof(xt_auto_lane_t));
+    for(i=0;i<lanes;i++) {
+        mLanes[i].Mode=XT_AUTO_OFF;
+        mLanes[i].Sent=-1;
+    }
+    mPlaying=0;
+    mStartPos=0;
+    mStartClock=0;
+    mStopPos=0;
+    mMotorInterval=XT_AUTO_MOTOR_MS;
+    mMap=NULL;
+    mMapLen=0;
+    mOutputCallbackHandler=NULL;
+    mOutputCallbackData=NULL;
+}
+
+XTouchAutomation::~XTouchAutomation() {
+    int i;
+    for(i=0;i<mLaneCount;i++) {
+        Release(&mLanes[i]);
+        free(mLanes[i].Pass);
+    }
+    free(mLanes);
+    Unmap();
+}
+
+// The handler registered here is called with the lane and level whenever playback moves a fader
+void XTouchAutomation::RegisterOutputCallback(automation_handler Handler, void *data) {
+    mOutputCallbackHandler=Handler;
+    mOutputCallbackData=data;
+}
+
+// Sets the shortest time between levels sent for each lane, to suit the fader motors
+void XTouchAutomation::SetMotorInterval(int ms) {
+    if (ms<1) ms=1;
+    mMotorInterval=ms;
+}
+
+void XTouchAutomation::SetMode(int lane, xt_auto_mode_t mode) {
+    xt_auto_lane_t *l;
+    uint32_t pos;
+    if ((lane<0)||(lane>=mLaneCount)||(mode>XT_AUTO_WRITE)) return;
+    l=&mLanes[lane];
+    pos=Position();
+    if ((l->Writing)&&((mode==XT_AUTO_OFF)||(mode==XT_AUTO_READ)||((mode==XT_AUTO_TOUCH)&&(!l->Touched)))) PunchOut(l,pos);
+    l->Mode=mode;
+    if ((mPlaying)&&(!l->Writing)&&((mode==XT_AUTO_WRITE)||((l->Touched)&&(mode!=XT_AUTO_READ)&&(mode!=XT_AUTO_OFF)))) PunchIn(l,pos);
+    if (mode!=XT_AUTO_OFF) l->Pending=1;
+}
+
+xt_auto_mode_t XTouchAutomation::Mode(int lane) {
+    if ((lane<0)||(lane>=mLaneCount)) return XT_AUTO_OFF;
+    return mLanes[lane].Mode;
+}
+
+// Call when the lane's fader is touched or released
+void XTouchAutomation::Touch(int lane, int touched) {
+    xt_auto_lane_t *l;
+    if ((lane<0)||(lane>=mLaneCount)) return;
+    l=&mLanes[lane];
+    l->Touched=touched;
+    if (!mPlaying) return;
+    if ((touched)&&(!l->Writing)&&((l->Mode==XT_AUTO_TOUCH)||(l->Mode==XT_AUTO_LATCH))) PunchIn(l,Position());
+    if ((!touched)&&(l->Writing)&&(l->Mode==XT_AUTO_TOUCH)) PunchOut(l,Position());
+}
+
+// Call whenever the lane's fader is moved (0-16383). Recorded if the lane is being written
+void XTouchAutomation::Move(int lane, int level) {
+    xt_auto_lane_t *l;
+    if ((lane<0)||(lane>=mLaneCount)) return;
+    l=&mLanes[lane];
+    l->Level=level;
+    l->Sent=level;
+    if (l->Writing) Record(l,Position(),level);
+}
+
+// Removes all of the lane's automation
+void XTouchAutomation::Clear(int lane) {
+    xt_auto_lane_t *l;
+    if ((lane<0)||(lane>=mLaneCount)) return;
+    l=&mLanes[lane];
+    Release(l);
+    l->PassCount=0;
+    l->Writing=0;
+    Seek(l,Position());
+}
+
+int XTouchAutomation::Points(int lane) {
+    if ((lane<0)||(lane>=mLaneCount)) return 0;
+    return mLanes[lane].Count;
+}
+
+unsigned int XTouchAutomation::Bytes(int lane) {
+    if ((lane<0)||(lane>=mLaneCount)) return 0;
+    return mLanes[lane].Len;
+}
+
+int XTouchAutomation::Lanes() {
+    return mLaneCount;
+}
+
+void XTouchAutomation::Play() {
+    int i;
+    xt_auto_lane_t *l;
+    if (mPlaying) return;
+    mStartPos=mStopPos;
+    mStartClock=Now();
+    mPlaying=1;
+    for(i=0;i<mLaneCount;i++) {
+        l=&mLanes[i];
+        Seek(l,mStartPos);
+        if ((l->Mode==XT_AUTO_WRITE)||((l->Touched)&&((l->Mode==XT_AUTO_TOUCH)||(l->Mode==XT_AUTO_LATCH)))) PunchIn(l,mStartPos);
+    }
+}
+
+// Ends any recording passes
+void XTouchAutomation::Stop() {
+    int i;
+    if (!mPlaying) return;
+    mStopPos=Position();
+    mPlaying=0;
+    for(i=0;i<mLaneCount;i++) {
+        if (mLanes[i].Writing) PunchOut(&mLanes[i],mStopPos);
+    }
+}
+
+// Moves the transport to ms. The faders of lanes being read follow, even if stopped
+void XTouchAutomation::Locate(uint32_t ms) {
+    int i;
+    int playing=mPlaying;
+    Stop();
+    mStopPos=ms;
+    for(i=0;i<mLaneCount;i++) {
+        Seek(&mLanes[i],ms);
+        mLanes[i].Pending=1;
+    }
+    if (playing) Play();
+}
+
+uint32_t XTouchAutomation::Position() {
+    if (!mPlaying) return mStopPos;
+    return mStartPos+(uint32_t)(Now()-mStartClock);
+}
+
+int XTouchAutomation::Playing() {
+    return mPlaying;
+}
+
+// Sends the levels of the lanes being played back. Returns how many ms until it's next needed,
+// or -1 if nothing is playing
+int XTouchAutomation::Tick() {
+    int i;
+    int level;
+    int64_t now;
+    uint32_t pos;
+    xt_auto_lane_t *l;
+
+    now=Now();
+    pos=Position();
+    for(i=0;i<mLaneCount;i++) {
+        l=&mLanes[i];
+        if ((l->Mode==XT_AUTO_OFF)||(l->Mode==XT_AUTO_WRITE)||(l->Writing)||(l->Count==0)) {
+            l->Pending=0;
+            continue;
+        }
+        if ((!mPlaying)&&(!l->Pending)) continue;
+        Advance(l,pos);
+        level=ValueAt(l,pos);
+        if (level==l->Sent) {
+            l->Pending=0;
+            continue;
+        }
+        if ((!l->Pending)&&(now-l->SentAt<mMotorInterval)) continue;
+        l->Pending=0;
+        l->Level=level;
+        l->Sent=level;
+        l->SentAt=now;
+        if (mOutputCallbackHandler) mOutputCallbackHandler(mOutputCallbackData,i,level);
+    }
+    return mPlaying?mMotorInterval:-1;
+}
+
+// Replaces all the lanes with those in the file (as written by Save()), which is mapped
+// into memory rather than read. Lanes are only copied out of it once they are recorded over
+// Returns 1 if successful
+int XTouchAutomation::Load(const char *filename) {
+    xt_auto_file_header_t *header;
+    xt_auto_file_lane_t *table;
+    xt_auto_point_t point;
+    struct stat st;
+    void *map;
+    const unsigned char *data;
+    unsigned int i;
+    unsigned int lanes;
+    unsigned int offset;
+    unsigned int points;
+    int ok;
+    int fd;
+
+    fd=open(filename,O_RDONLY);
+    if (fd<0) {
+        perror("ERROR opening automation");
+        return 0;
+    }
+    if ((fstat(fd,&st)<0)||(st.st_size<(off_t)sizeof(xt_auto_file_header_t))) {
+        printf("Automation file %s is too short\n",filename);
+        close(fd);
+        return 0;
+    }
+    map=mmap(NULL,st.st_size,PROT_READ,MAP_PRIVATE,fd,0);
+    close(fd);
+    if (map==MAP_FAILED) {
+        perror("ERROR mapping automation");
+        return 0;
+    }
+    header=(xt_auto_file_header_t *)map;
+    table=(xt_auto_file_lane_t *)(header+1);
+    lanes=header->Lanes;
+    if ((header->Magic!=XT_AUTO_MAGIC)||(header->Version!=XT_AUTO_VERSION)||
+        (sizeof(xt_auto_file_header_t)+(uint64_t)lanes*sizeof(xt_auto_file_lane_t)>(uint64_t)st.st_size)) {
+        printf("%s isn't an automation file of version %d\n",filename,XT_AUTO_VERSION);
+        munmap(map,st.st_size);
+        return 0;
+    }
+    // Every lane must be exactly Count whole points
+    for(i=0;i<lanes;i++) {
+        ok=((table[i].Offset<=(uint64_t)st.st_size)&&(table[i].Len<=st.st_size-table[i].Offset));
+        points=0;
+        offset=0;
+        point.Time=0;
+        point.Level=0;
+        data=ok?(const unsigned char *)map+table[i].Offset:NULL;
+        while ((ok)&&(offset<table[i].Len)) {
+            ok=Decode(data,table[i].Len,&offset,&point);
+            points+=ok;
+        }
+        if ((!ok)||(points!=table[i].Count)) {
+            printf("Automation file %s is damaged (lane %d)\n",filename,i);
+            munmap(map,st.st_size);
+            return 0;
+        }
+    }
+    if (lanes>(unsigned int)mLaneCount) {
+        printf("Automation file %s has %d lanes, only loading the first %d\n",filename,lanes,mLaneCount);
+        lanes=mLaneCount;
+    }
+
+    Stop();
+    for(i=0;i<(unsigned int)mLaneCount;i++) {
+        Release(&mLanes[i]);
+        if (i<lanes) {
+            mLanes[i].Data=(const unsigned char *)map+table[i].Offset;
+            mLanes[i].Len=table[i].Len;
+            mLanes[i].Count=table[i].Count;
+        }
+        Seek(&mLanes[i],mStopPos);
+        mLanes[i].Pending=1;
+    }
+    Unmap();
+    mMap=map;
+    mMapLen=st.st_size;
+    return 1;
+}
+
+// Writes all the lanes to a file (via a temporary file, so a file that is loaded can be saved
+// over). Passes still being recorded aren't included. Returns 1 if successful
+int XTouchAutomation::Save(const char *filename) {
+    xt_auto_file_header_t header;
+    xt_auto_file_lane_t entry;
+    char tempname[1024];
+    uint64_t offset;
+    FILE *f;
+    int ok;
+    int i;
+
+    snprintf(tempname,sizeof(tempname),"%s.tmp",filename);
+    f=fopen(tempname,"wb");
+    if (!f) {
+        perror("ERROR saving automation");
+        return 0;
+    }
+    header.Magic=XT_AUTO_MAGIC;
+    header.Version=XT_AUTO_VERSION;
+    header.Lanes=mLaneCount;
+    header.Reserved=0;
+    ok=(fwrite(&header,sizeof(header),1,f)==1);
+    offset=sizeof(header)+(uint64_t)mLaneCount*sizeof(entry);
+    for(i=0;i<mLaneCount;i++) {
+        entry.Offset=offset;
+        entry.Len=mLanes[i].Len;
+        entry.Count=mLanes[i].Count;
+        ok=ok&&(fwrite(&entry,sizeof(entry),1,f)==1);
+        offset+=mLanes[i].Len;
+    }
+    for(i=0;i<mLaneCount;i++) {
+        if (mLanes[i].Len) ok=ok&&(fwrite(mLanes[i].Data,mLanes[i].Len,1,f)==1);
+    }
+    if (fclose(f)!=0) ok=0;
+    if ((!ok)||(rename(tempname,filename)<0)) {
+        perror("ERROR saving automation");
+        unlink(tempname);
+        return 0;
+    }
+    return 1;
+}
+
+// ----------------------------------------------------------------------------------------------
+// Private functions
+// ----------------------------------------------------------------------------------------------
+
+int64_t XTouchAutomation::Now() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC,&ts);
+    return (int64_t)ts.tv_sec*1000+ts.tv_nsec/1000000;
+}
+
+// Appends point to the buffer, which must have XT_AUTO_POINT_BYTES free, as the difference from base
+// base is then updated to point
+void XTouchAutomation::Encode(unsigned char *buffer, unsigned int *len, xt_auto_point_t *base, xt_auto_point_t point) {
+    uint32_t delta;
+
+    delta=point.Time-base->Time;
+    while (delta>=0x80) {
+        buffer[(*len)++]=(delta&0x7f)|0x80;
+        delta>>=7;
+    }
+    buffer[(*len)++]=delta;
+    delta=point.Level-base->Level;
+    delta=(delta<<1)^(uint32_t)((point.Level-base->Level)>>31);     // Zigzag, so small falls are short too
+    while (delta>=0x80) {
+        buffer[(*len)++]=(delta&0x7f)|0x80;
+        delta>>=7;
+    }
+    buffer[(*len)++]=delta;
+    *base=point;
+}
+
+// Reads the point at offset, encoded as the difference from point, into point
+// Returns 0 if the point runs past end
+int XTouchAutomation::Decode(const unsigned char *buffer, unsigned int end, unsigned int *offset, xt_auto_point_t *point) {
+    uint32_t delta;
+    unsigned char b;
+    int shift;
+
+    delta=0;
+    shift=0;
+    do {
+        if (*offset>=end) return 0;
+        b=buffer[(*offset)++];
+        delta|=(uint32_t)(b&0x7f)<<shift;
+        shift+=7;
+    } while ((b&0x80)&&(shift<35));
+    point->Time+=delta;
+    delta=0;
+    shift=0;
+    do {
+        if (*offset>=end) return 0;
+        b=buffer[(*offset)++];
+        delta|=(uint32_t)(b&0x7f)<<shift;
+        shift+=7;
+    } while ((b&0x80)&&(shift<35));
+    point->Level+=(int32_t)((delta>>1)^(0-(delta&1)));
+    return 1;
+}
+
+// Puts the lane's playback cursor at pos
+void XTouchAutomation::Seek(xt_auto_lane_t *lane, uint32_t pos) {
+    lane->Cursor=0;
+    lane->HavePrev=0;
+    lane->HaveNext=0;
+    lane->Next.Time=0;
+    lane->Next.Level=0;
+    if ((lane->Count==0)||(!Decode(lane->Data,lane->Len,&lane->Cursor,&lane->Next))) return;
+    lane->HaveNext=1;
+    Advance(lane,pos);
+}
+
+// Moves the playback cursor forwards to pos
+void XTouchAutomation::Advance(xt_auto_lane_t *lane, uint32_t pos) {
+    if ((lane->HavePrev)&&(pos<lane->Prev.Time)) {
+        Seek(lane,pos);
+        return;
+    }
+    while ((lane->HaveNext)&&(lane->Next.Time<=pos)) {
+        lane->Prev=lane->Next;
+        lane->HavePrev=1;
+        lane->HaveNext=Decode(lane->Data,lane->Len,&lane->Cursor,&lane->Next);
+    }
+}
+
+// The lane's level at pos, which the cursor must be at. -1 if the lane is empty
+int XTouchAutomation::ValueAt(xt_auto_lane_t *lane, uint32_t pos) {
+    if ((!lane->HavePrev)&&(!lane->HaveNext)) return -1;
+    if (!lane->HavePrev) return lane->Next.Level;
+    if (!lane->HaveNext) return lane->Prev.Level;
+    return lane->Prev.Level+(int)((int64_t)(lane->Next.Level-lane->Prev.Level)*(pos-lane->Prev.Time)/(lane->Next.Time-lane->Prev.Time));
+}
+
+// Adds a point to the pass being recorded. Only the last level in each ms is kept
+void XTouchAutomation::Record(xt_auto_lane_t *lane, uint32_t pos, int level) {
+    xt_auto_point_t *last;
+    if (lane->PassCount>0) {
+        last=&lane->Pass[lane->PassCount-1];
+        if (pos<=last->Time) {
+            last->Level=level;
+            return;
+        }
+        if ((level==last->Level)&&(lane->PassCount>1)&&(last[-1].Level==level)) {
+            last->Time=pos;             // Still holding the same level, so just move the end along
+            return;
+        }
+    }
+    if (lane->PassCount==lane->PassCap) {
+        lane->PassCap=lane->PassCap?lane->PassCap*2:256;
+        lane->Pass=(xt_auto_point_t *)realloc(lane->Pass,lane->PassCap*sizeof(xt_auto_point_t));
+    }
+    lane->Pass[lane->PassCount].Time=pos;
+    lane->Pass[lane->PassCount].Level=level;
+    lane->PassCount++;
+}
+
+void XTouchAutomation::PunchIn(xt_auto_lane_t *lane, uint32_t pos) {
+    lane->Writing=1;
+    lane->PassStart=pos;
+    lane->PassCount=0;
+    Record(lane,pos,lane->Level);
+}
+
+void XTouchAutomation::PunchOut(xt_auto_lane_t *lane, uint32_t pos) {
+    Record(lane,pos,lane->Level);
+    Merge(lane,pos);
+    lane->Writing=0;
+    lane->PassCount=0;
+    lane->Sent=lane->Level;
+    Seek(lane,pos);
+}
+
+// Replaces the lane between the start of the pass and end with the pass, then glides
+// back to the old automation
+void XTouchAutomation::Merge(xt_auto_lane_t *lane, uint32_t end) {
+    unsigned char *buffer;
+    unsigned int len;
+    unsigned int offset;
+    unsigned int count;
+    unsigned int i;
+    unsigned int after;
+    unsigned int points;
+    uint32_t glide;
+    xt_auto_point_t *old;
+    xt_auto_point_t base;
+    xt_auto_point_t point;
+
+    old=(xt_auto_point_t *)malloc((lane->Count+1)*sizeof(xt_auto_point_t));
+    offset=0;
+    point.Time=0;
+    point.Level=0;
+    for(i=0;(i<lane->Count)&&(Decode(lane->Data,lane->Len,&offset,&point));i++) {
+        old[i]=point;
+    }
+    count=i;
+
+    buffer=(unsigned char *)malloc((count+lane->PassCount+1)*XT_AUTO_POINT_BYTES);
+    len=0;
+    points=0;
+    base.Time=0;
+    base.Level=0;
+    for(i=0;(i<count)&&(old[i].Time<lane->PassStart);i++) {
+        Encode(buffer,&len,&base,old[i]);
+        points++;
+    }
+    for(i=0;i<lane->PassCount;i++) {
+        Encode(buffer,&len,&base,lane->Pass[i]);
+        points++;
+    }
+    // Back to the old level XT_AUTO_GLIDE_MS later, then the old points from there on
+    if (count>0) {
+        glide=end+XT_AUTO_GLIDE_MS;
+        for(after=0;(after<count)&&(old[after].Time<=glide);after++);
+        if (after==0) {
+            point.Level=old[0].Level;
+        } else if (after==count) {
+            point.Level=old[count-1].Level;
+        } else {
+            point.Level=old[after-1].Level+(int)((int64_t)(old[after].Level-old[after-1].Level)*(glide-old[after-1].Time)/(old[after].Time-old[after-1].Time));
+        }
+        point.Time=glide;
+        Encode(buffer,&len,&base,point);
+        points++;
+        for(i=after;i<count;i++) {
+            Encode(buffer,&len,&base,old[i]);
+            points++;
+        }
+    }
+    free(old);
+
+    Release(lane);
+    lane->Owned=buffer;
+    lane->Data=buffer;
+    lane->Len=len;
+    lane->Count=points;
+}
+
+// Frees the lane's points (which are left alone if they are in the mapped file)
+void XTouchAutomation::Release(xt_auto_lane_t *lane) {
+    free(lane->Owned);
+    lane->Owned=NULL;
+    lane->Data=NULL;
+    lane->Len=0;
+    lane->Count=0;
+    lane->HavePrev=0;
+    lane->HaveNext=0;
+}
+
+// Unmaps the loaded file, once no lane uses it
+void XTouchAutomation::Unmap() {
+    if (mMap) munmap(mMap,mMapLen);
+    mMap=NULL;
+    mMapLen=0;
+}
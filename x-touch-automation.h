@@ -0,0 +1,181 @@
+/* ----------------------------------------------------------------
+                   x-touch-xctl library - fader automation.
+   Records fader moves per channel against a transport clock and
+   plays them back to the motor faders, with the usual read, touch,
+   latch and write modes. Lanes can be saved to a file that is
+   mapped straight back into memory when loaded.
+   ---------------------------------------------------------------- */
+
+
+/*
+MIT License
+
+Copyright (c) 2020 Martin Whitaker
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+/* Each lane is a list of points (time in ms from the start of the transport,
+   fader level), stored as the difference from the previous point: a varint for
+   the time and a zigzag varint for the level, so a typical move takes 2-3 bytes.
+   Between points the level is interpolated.
+
+   Modes, whilst the transport is playing:
+     READ   plays the lane back, moving the fader
+     TOUCH  plays back, but records over the lane whilst the fader is touched
+     LATCH  as TOUCH, but carries on recording after it's released until stopped
+     WRITE  records over the lane for as long as the transport plays
+   A recording pass is kept to one side and merged into the lane when it ends,
+   gliding back to the old automation over XT_AUTO_GLIDE_MS.
+
+   Playback is sent to the output callback no more often than the motor interval
+   (XT_AUTO_MOTOR_MS by default) per lane, and only when the level changes. All
+   lanes are recorded and played by Tick() on the caller's thread.
+
+   Usage:
+     XTouchAutomation automation(64);
+     automation.RegisterOutputCallback(handler,data);  // Move the fader for lane n
+     automation.SetMode(0,XT_AUTO_TOUCH);
+     ... fader events: automation.Touch(lane,touched); automation.Move(lane,level);
+     automation.Play();
+     while (1) {
+         transport->Poll(automation.Tick());
+     }
+     automation.Stop();
+     automation.Save("mix.xta");
+*/
+
+#ifndef X_TOUCH_AUTOMATION_H
+#define X_TOUCH_AUTOMATION_H
+
+#include <stdint.h>
+
+enum xt_auto_mode_t { XT_AUTO_OFF, XT_AUTO_READ, XT_AUTO_TOUCH, XT_AUTO_LATCH, XT_AUTO_WRITE };
+
+#define XT_AUTO_MAGIC 0x55415458    // "XTAU"
+#define XT_AUTO_VERSION 1
+#define XT_AUTO_MOTOR_MS 10         // Shortest time between levels sent to a fader
+#define XT_AUTO_GLIDE_MS 100        // Time taken to return to the old automation after a pass
+
+typedef void (*automation_handler)(void *, int, int); // User pointer, Lane, Level
+
+typedef struct {
+    uint32_t Time;                  // ms
+    int32_t Level;
+} xt_auto_point_t;
+
+// File layout: the header, a table entry per lane, then the encoded lanes
+typedef struct {
+    uint32_t Magic;
+    uint32_t Version;
+    uint32_t Lanes;
+    uint32_t Reserved;
+} xt_auto_file_header_t;
+
+typedef struct {
+    uint64_t Offset;                // From the start of the file
+    uint32_t Len;                   // Bytes
+    uint32_t Count;                 // Points
+} xt_auto_file_lane_t;
+
+typedef struct {
+    const unsigned char *Data;      // Encoded points, either Owned or in the mapped file
+    unsigned char *Owned;
+    unsigned int Len;
+    unsigned int Count;
+
+    // Playback cursor: the points either side of the position and where to decode the next one
+    unsigned int Cursor;
+    int HavePrev;
+    int HaveNext;
+    xt_auto_point_t Prev;
+    xt_auto_point_t Next;
+
+    // Recording pass
+    xt_auto_point_t *Pass;
+    unsigned int PassCount;
+    unsigned int PassCap;
+    uint32_t PassStart;
+    int Writing;
+
+    xt_auto_mode_t Mode;
+    int Touched;
+    int Level;                      // Where the fader is
+    int Sent;                       // Last level sent to the output, -1 if none
+    int64_t SentAt;
+    int Pending;                    // Send the level at the position even when stopped
+} xt_auto_lane_t;
+
+class XTouchAutomation {
+    public:
+        XTouchAutomation(int lanes);
+        ~XTouchAutomation();
+
+        void RegisterOutputCallback(automation_handler Handler, void *data);
+        void SetMotorInterval(int ms);
+
+        void SetMode(int lane, xt_auto_mode_t mode);
+        xt_auto_mode_t Mode(int lane);
+        void Touch(int lane, int touched);
+        void Move(int lane, int level);
+        void Clear(int lane);
+        int Points(int lane);
+        unsigned int Bytes(int lane);
+        int Lanes();
+
+        void Play();
+        void Stop();
+        void Locate(uint32_t ms);
+        uint32_t Position();
+        int Playing();
+        int Tick();
+
+        int Load(const char *filename);
+        int Save(const char *filename);
+
+    private:
+        static int64_t Now();
+        static void Encode(unsigned char *buffer, unsigned int *len, xt_auto_point_t *base, xt_auto_point_t point);
+        static int Decode(const unsigned char *buffer, unsigned int end, unsigned int *offset, xt_auto_point_t *point);
+        void Seek(xt_auto_lane_t *lane, uint32_t pos);
+        void Advance(xt_auto_lane_t *lane, uint32_t pos);
+        int ValueAt(xt_auto_lane_t *lane, uint32_t pos);
+        void Record(xt_auto_lane_t *lane, uint32_t pos, int level);
+        void PunchIn(xt_auto_lane_t *lane, uint32_t pos);
+        void PunchOut(xt_auto_lane_t *lane, uint32_t pos);
+        void Merge(xt_auto_lane_t *lane, uint32_t end);
+        void Release(xt_auto_lane_t *lane);
+        void Unmap();
+
+        xt_auto_lane_t *mLanes;
+        int mLaneCount;
+        int mPlaying;
+        uint32_t mStartPos;         // Position when play started
+        int64_t mStartClock;        // and the time it did
+        uint32_t mStopPos;
+        int mMotorInterval;
+
+        void *mMap;                 // Loaded file
+        unsigned int mMapLen;
+
+        automation_handler mOutputCallbackHandler;
+        void *mOutputCallbackData;
+};
+
+#endif
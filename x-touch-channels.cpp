@@ -0,0 +1,324 @@
+/* ----------------------------------------------------------------
+                   x-touch-xctl library - channel state store.
+   Holds the state of every channel on the desk being controlled
+   (which may be far more than the 8 strips on the X-Touch) and
+   tracks which fields have changed so that only the visible bank
+   window needs to be redrawn.
+   ---------------------------------------------------------------- */
+
+/*
+MIT License
+
+Copyright (c) 2020 Martin Whitaker
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#include "x-touch-channels.h"
+#include <string.h>
+
+// Public interfaces
+// channels = total number of channels on the desk
+// window = number of channels shown at once (one bank), 1 to 64
+XTouchChannelStore::XTouchChannelStore(int channels, int window) {
+    int i;
+    if (channels<1) channels=1;
+    if (window<1) window=1;
+    if (window>64) window=64;
+    mChannels=channels;
+    mWords=(channels+63)/64;
+    mWindow=window;
+    mBank=0;
+
+    mLevel=new int[channels];
+    mTrim=new signed char[channels];
+    mPan=new signed char[channels];
+    mMode=new unsigned char[channels];
+    mMeter=new unsigned char[channels];
+    mName=new char[channels][XT_CH_NAME_LEN];
+    mColour=new unsigned char[channels];
+    // One spare word so a window can always be read as two whole words
+    mMute=new uint64_t[mWords+1];
+    mSolo=new uint64_t[mWords+1];
+    mRec=new uint64_t[mWords+1];
+    for(i=0;i<XT_CH_FIELDS;i++) {
+        mDirty[i]=new uint64_t[mWords+1];
+        memset(mDirty[i],0,(mWords+1)*sizeof(uint64_t));
+    }
+
+    memset(mLevel,0,channels*sizeof(int));
+    memset(mTrim,0,channels);
+    memset(mPan,0,channels);
+    memset(mMode,0,channels);
+    memset(mMeter,0,channels);
+    memset(mName,0,channels*XT_CH_NAME_LEN);
+    memset(mColour,WHITE,channels);
+    memset(mMute,0,(mWords+1)*sizeof(uint64_t));
+    memset(mSolo,0,(mWords+1)*sizeof(uint64_t));
+    memset(mRec,0,(mWords+1)*sizeof(uint64_t));
+}
+
+XTouchChannelStore::~XTouchChannelStore() {
+    int i;
+    delete[] mLevel;
+    delete[] mTrim;
+    delete[] mPan;
+    delete[] mMode;
+    delete[] mMeter;
+    delete[] mName;
+    delete[] mColour;
+    delete[] mMute;
+    delete[] mSolo;
+    delete[] mRec;
+    for(i=0;i<XT_CH_FIELDS;i++) {
+        delete[] mDirty[i];
+    }
+}
+
+int XTouchChannelStore::Channels() {
+    return mChannels;
+}
+
+int XTouchChannelStore::WindowSize() {
+    return mWindow;
+}
+
+int XTouchChannelStore::BankCount() {
+    return (mChannels+mWindow-1)/mWindow;
+}
+
+int XTouchChannelStore::Bank() {
+    return mBank;
+}
+
+// Returns the first channel in the visible window
+int XTouchChannelStore::WindowStart() {
+    return mBank*mWindow;
+}
+
+// Moves the visible window. Everything in the new window is marked dirty
+void XTouchChannelStore::SetBank(int bank) {
+    if ((bank<0)||(bank>=BankCount())) return;
+    mBank=bank;
+    MarkWindowDirty();
+}
+
+int XTouchChannelStore::Level(int channel) {
+    return Valid(channel)?mLevel[channel]:0;
+}
+
+int XTouchChannelStore::Trim(int channel) {
+    return Valid(channel)?mTrim[channel]:0;
+}
+
+int XTouchChannelStore::Pan(int channel) {
+    return Valid(channel)?mPan[channel]:0;
+}
+
+int XTouchChannelStore::Mode(int channel) {
+    return Valid(channel)?mMode[channel]:0;
+}
+
+int XTouchChannelStore::Meter(int channel) {
+    return Valid(channel)?mMeter[channel]:0;
+}
+
+int XTouchChannelStore::Mute(int channel) {
+    return Valid(channel)?GetBit(mMute,channel):0;
+}
+
+int XTouchChannelStore::Solo(int channel) {
+    return Valid(channel)?GetBit(mSolo,channel):0;
+}
+
+int XTouchChannelStore::Rec(int channel) {
+    return Valid(channel)?GetBit(mRec,channel):0;
+}
+
+const char *XTouchChannelStore::Name(int channel) {
+    return Valid(channel)?mName[channel]:"";
+}
+
+xt_colours_t XTouchChannelStore::Colour(int channel) {
+    return Valid(channel)?(xt_colours_t)mColour[channel]:WHITE;
+}
+
+// Fader level, 0 to 16383 (see XTouch::SetFaderLevel)
+void XTouchChannelStore::SetLevel(int channel, int level) {
+    if ((!Valid(channel))||(mLevel[channel]==level)) return;
+    mLevel[channel]=level;
+    MarkDirty(XT_CH_LEVEL,channel);
+}
+
+// Trim level, 0 to 13 (see XTouch::SetDialLevel)
+void XTouchChannelStore::SetTrim(int channel, int level) {
+    if ((!Valid(channel))||(level<0)||(level>13)||(mTrim[channel]==level)) return;
+    mTrim[channel]=level;
+    MarkDirty(XT_CH_TRIM,channel);
+}
+
+// Pan position, -6 to +6 (see XTouch::SetDialPan)
+void XTouchChannelStore::SetPan(int channel, int position) {
+    if ((!Valid(channel))||(position<-6)||(position>6)||(mPan[channel]==position)) return;
+    mPan[channel]=position;
+    MarkDirty(XT_CH_PAN,channel);
+}
+
+// Application defined dial mode, 0 to 255
+void XTouchChannelStore::SetMode(int channel, int mode) {
+    if ((!Valid(channel))||(mode<0)||(mode>255)||(mMode[channel]==mode)) return;
+    mMode[channel]=mode;
+    MarkDirty(XT_CH_MODE,channel);
+}
+
+// Meter level, 0 to 9 (see XTouch::SetMeterLevel)
+void XTouchChannelStore::SetMeter(int channel, int level) {
+    if ((!Valid(channel))||(level<0)||(level>9)||(mMeter[channel]==level)) return;
+    mMeter[channel]=level;
+    MarkDirty(XT_CH_METER,channel);
+}
+
+void XTouchChannelStore::SetMute(int channel, int on) {
+    if ((Valid(channel))&&(SetBit(mMute,channel,on))) MarkDirty(XT_CH_MUTE,channel);
+}
+
+void XTouchChannelStore::SetSolo(int channel, int on) {
+    if ((Valid(channel))&&(SetBit(mSolo,channel,on))) MarkDirty(XT_CH_SOLO,channel);
+}
+
+void XTouchChannelStore::SetRec(int channel, int on) {
+    if ((Valid(channel))&&(SetBit(mRec,channel,on))) MarkDirty(XT_CH_REC,channel);
+}
+
+// Names longer than XT_CH_NAME_LEN-1 characters are truncated
+void XTouchChannelStore::SetName(int channel, const char *name) {
+    if ((!Valid(channel))||(strncmp(mName[channel],name,XT_CH_NAME_LEN-1)==0)) return;
+    strncpy(mName[channel],name,XT_CH_NAME_LEN-1);
+    mName[channel][XT_CH_NAME_LEN-1]=0;
+    MarkDirty(XT_CH_NAME,channel);
+}
+
+void XTouchChannelStore::SetColour(int channel, xt_colours_t colour) {
+    if ((!Valid(channel))||(mColour[channel]==colour)) return;
+    mColour[channel]=colour;
+    MarkDirty(XT_CH_COLOUR,channel);
+}
+
+// Returns 1 if any channel on the desk is soloed
+int XTouchChannelStore::AnySolo() {
+    int i;
+    for(i=0;i<mWords;i++) {
+        if (mSolo[i]) return 1;
+    }
+    return 0;
+}
+
+// Returns 1 if the channel would be heard - not muted, and soloed if anything is
+int XTouchChannelStore::Audible(int channel) {
+    if ((!Valid(channel))||(GetBit(mMute,channel))) return 0;
+    return (!AnySolo())||(GetBit(mSolo,channel));
+}
+
+// Returns the highest meter level of all the audible channels, e.g. for a master meter
+int XTouchChannelStore::AudiblePeak() {
+    int i, bit, peak=0;
+    int solo=AnySolo();
+    uint64_t audible;
+    for(i=0;i<mWords;i++) {
+        audible=~mMute[i];
+        if (solo) audible&=mSolo[i];
+        if ((i==mWords-1)&&(mChannels&63)) audible&=(((uint64_t)1)<<(mChannels&63))-1;
+        while (audible) {
+            bit=__builtin_ctzll(audible);
+            if (mMeter[i*64+bit]>peak) peak=mMeter[i*64+bit];
+            audible&=audible-1;
+        }
+    }
+    return peak;
+}
+
+// Returns which channels in the visible window have changed in this field
+// bit 0 = first channel in the window
+uint64_t XTouchChannelStore::DirtyInWindow(xt_channel_field_t field) {
+    int start=WindowStart();
+    int word=start/64;
+    int shift=start&63;
+    uint64_t bits;
+    if ((field<0)||(field>=XT_CH_FIELDS)) return 0;
+    bits=mDirty[field][word]>>shift;
+    if (shift) bits|=mDirty[field][word+1]<<(64-shift);
+    if (mWindow<64) bits&=(((uint64_t)1)<<mWindow)-1;
+    return bits;
+}
+
+// Clears a single dirty flag, e.g. when the change came from the surface itself
+void XTouchChannelStore::ClearDirty(xt_channel_field_t field, int channel) {
+    if ((field<0)||(field>=XT_CH_FIELDS)||(!Valid(channel))) return;
+    SetBit(mDirty[field],channel,0);
+}
+
+// Call once the visible window has been redrawn
+void XTouchChannelStore::ClearWindowDirty() {
+    int i, f;
+    int start=WindowStart();
+    for(i=start;(i<start+mWindow)&&(i<mChannels);i++) {
+        for(f=0;f<XT_CH_FIELDS;f++) {
+            SetBit(mDirty[f],i,0);
+        }
+    }
+}
+
+// Forces the whole visible window to be redrawn
+void XTouchChannelStore::MarkWindowDirty() {
+    int i, f;
+    int start=WindowStart();
+    for(i=start;(i<start+mWindow)&&(i<mChannels);i++) {
+        for(f=0;f<XT_CH_FIELDS;f++) {
+            SetBit(mDirty[f],i,1);
+        }
+    }
+}
+
+// ----------------------------------------------------------------------------------------------
+// Private functions
+// ----------------------------------------------------------------------------------------------
+
+int XTouchChannelStore::Valid(int channel) {
+    return (channel>=0)&&(channel<mChannels);
+}
+
+void XTouchChannelStore::MarkDirty(xt_channel_field_t field, int channel) {
+    SetBit(mDirty[field],channel,1);
+}
+
+int XTouchChannelStore::GetBit(uint64_t *bits, int channel) {
+    return (bits[channel>>6]>>(channel&63))&1;
+}
+
+// Returns 1 if the bit changed
+int XTouchChannelStore::SetBit(uint64_t *bits, int channel, int on) {
+    uint64_t mask=((uint64_t)1)<<(channel&63);
+    uint64_t old=bits[channel>>6];
+    if (on) {
+        bits[channel>>6]|=mask;
+    } else {
+        bits[channel>>6]&=~mask;
+    }
+    return bits[channel>>6]!=old;
+}
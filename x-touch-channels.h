@@ -0,0 +1,119 @@
+/* ----------------------------------------------------------------
+                   x-touch-xctl library - channel state store.
+   Holds the state of every channel on the desk being controlled
+   (which may be far more than the 8 strips on the X-Touch) and
+   tracks which fields have changed so that only the visible bank
+   window needs to be redrawn.
+   ---------------------------------------------------------------- */
+
+/*
+MIT License
+
+Copyright (c) 2020 Martin Whitaker
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+/* Each field is stored in its own array (mute, solo and rec as bitsets) so
+   that whole-desk scans such as "is anything soloed" only touch the data
+   they need. Every Set function marks the channel dirty in that field's
+   dirty bitset if the value actually changed. */
+
+#ifndef X_TOUCH_CHANNELS_H
+#define X_TOUCH_CHANNELS_H
+
+#include <stdint.h>
+#include "x-touch.h"
+
+enum xt_channel_field_t { XT_CH_LEVEL, XT_CH_TRIM, XT_CH_PAN, XT_CH_MODE, XT_CH_METER, XT_CH_MUTE, XT_CH_SOLO, XT_CH_REC, XT_CH_NAME, XT_CH_COLOUR, XT_CH_FIELDS };
+
+#define XT_CH_NAME_LEN 32
+
+class XTouchChannelStore {
+    public:
+        XTouchChannelStore(int channels, int window=8);
+        ~XTouchChannelStore();
+
+        int Channels();
+        int WindowSize();
+        int BankCount();
+        int Bank();
+        int WindowStart();
+        void SetBank(int bank);
+
+        int Level(int channel);
+        int Trim(int channel);
+        int Pan(int channel);
+        int Mode(int channel);
+        int Meter(int channel);
+        int Mute(int channel);
+        int Solo(int channel);
+        int Rec(int channel);
+        const char *Name(int channel);
+        xt_colours_t Colour(int channel);
+
+        void SetLevel(int channel, int level);
+        void SetTrim(int channel, int level);
+        void SetPan(int channel, int position);
+        void SetMode(int channel, int mode);
+        void SetMeter(int channel, int level);
+        void SetMute(int channel, int on);
+        void SetSolo(int channel, int on);
+        void SetRec(int channel, int on);
+        void SetName(int channel, const char *name);
+        void SetColour(int channel, xt_colours_t colour);
+
+        int AnySolo();
+        int Audible(int channel);
+        int AudiblePeak();
+
+        uint64_t DirtyInWindow(xt_channel_field_t field);
+        void ClearDirty(xt_channel_field_t field, int channel);
+        void ClearWindowDirty();
+        void MarkWindowDirty();
+
+    private:
+        int Valid(int channel);
+        void MarkDirty(xt_channel_field_t field, int channel);
+        int GetBit(uint64_t *bits, int channel);
+        int SetBit(uint64_t *bits, int channel, int on);
+
+        int mChannels;
+        int mWords;
+        int mWindow;
+        int mBank;
+
+        // Hot fields
+        int *mLevel;
+        signed char *mTrim;
+        signed char *mPan;
+        unsigned char *mMode;
+        unsigned char *mMeter;
+        uint64_t *mMute;
+        uint64_t *mSolo;
+        uint64_t *mRec;
+
+        // Cold fields
+        char (*mName)[XT_CH_NAME_LEN];
+        unsigned char *mColour;
+
+        uint64_t *mDirty[XT_CH_FIELDS];
+};
+
+#endif
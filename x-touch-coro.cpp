@@ -0,0 +1,288 @@
+/* ----------------------------------------------------------------
+                   x-touch-xctl library - coroutines.
+   Lets interactions with the X-Touch be written as C++20 coroutines
+   that wait for the events they need, e.g. wait for a fader to be
+   touched, follow it until it is let go, then act on where it was
+   left. Any number of these run on the one thread handling the
+   X-Touch.
+   ---------------------------------------------------------------- */
+
+
+/*
+MIT License
+
+Copyright (c) 2020 Martin Whitaker
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#include "x-touch-coro.h"
+#include <stdio.h>
+#include <exception>
+
+// ----------------------------------------------------------------------------------------------
+// Tasks and awaiters
+// ----------------------------------------------------------------------------------------------
+
+// Finished tasks are destroyed straight away
+void XTouchTask::promise_type::xt_final_awaiter_t::await_suspend(std::coroutine_handle<promise_type> handle) noexcept {
+    handle.promise().Surface->Finished(handle);
+}
+
+void XTouchTask::promise_type::unhandled_exception() {
+    printf("Unhandled exception in X-Touch task\n");
+    std::terminate();
+}
+
+XTouchTask::XTouchTask(std::coroutine_handle<promise_type> handle) {
+    mHandle=handle;
+}
+
+XTouchTask::XTouchTask(XTouchTask &&other) noexcept {
+    mHandle=other.mHandle;
+    other.mHandle=nullptr;
+}
+
+// A task that was never spawned is thrown away
+XTouchTask::~XTouchTask() {
+    if (mHandle) mHandle.destroy();
+}
+
+XTouchEventAwaiter::XTouchEventAwaiter(XTouchSurface *surface, int types, int id, int value) {
+    mSurface=surface;
+    mNode.Next=NULL;
+    mNode.Types=types;
+    mNode.Id=id;
+    mNode.Value=value;
+}
+
+void XTouchEventAwaiter::await_suspend(std::coroutine_handle<> handle) {
+    mNode.Handle=handle;
+    mSurface->Wait(&mNode);
+}
+
+XTouchFlushAwaiter::XTouchFlushAwaiter(XTouchSurface *surface) {
+    mSurface=surface;
+    mNode.Next=NULL;
+    mNode.Types=0;
+    mNode.Id=-1;
+    mNode.Value=-1;
+}
+
+void XTouchFlushAwaiter::await_suspend(std::coroutine_handle<> handle) {
+    mNode.Handle=handle;
+    mSurface->Wait(&mNode);
+}
+
+// ----------------------------------------------------------------------------------------------
+// Public interfaces
+// ----------------------------------------------------------------------------------------------
+
+// With a scheduler, Flush() waits until it has sent everything. Without one it only
+// waits until the batch of output from the tasks that have run has been sent
+XTouchSurface::XTouchSurface(XTouch *board, XTouchScheduler *scheduler) {
+    mBoard=board;
+    mScheduler=scheduler;
+    mWaiting=NULL;
+    mFlushing=NULL;
+    mReady=NULL;
+    mReadyTail=NULL;
+    mEventHead=0;
+    mEventCount=0;
+    mTasks=0;
+    mRunning=0;
+    mOverflows=0;
+}
+
+// Tasks still waiting are destroyed
+XTouchSurface::~XTouchSurface() {
+    xt_wait_node_t *lists[3]={mWaiting,mFlushing,mReady};
+    xt_wait_node_t *node;
+    xt_wait_node_t *next;
+    int i;
+    mWaiting=mFlushing=mReady=mReadyTail=NULL;
+    for(i=0;i<3;i++) {
+        for(node=lists[i];node;node=next) {
+            next=node->Next;
+            node->Handle.destroy();
+        }
+    }
+}
+
+// Starts a task. It first runs on the next Run()
+void XTouchSurface::Spawn(XTouchTask task) {
+    XTouchTask::promise_type *promise;
+    if (!task.mHandle) return;
+    promise=&task.mHandle.promise();
+    promise->Surface=this;
+    promise->Start.Handle=task.mHandle;
+    task.mHandle=nullptr;
+    mTasks++;
+    MakeReady(&promise->Start);
+}
+
+// Queues an event for the tasks. It is passed on by the next Run()
+void XTouchSurface::Post(xt_event_type_t type, int id, int value) {
+    xt_event_t *event;
+    if (mEventCount==XT_CORO_EVENTS) {
+        if ((mOverflows++%1000)==0) printf("X-Touch event queue full - call Run() more often\n");
+        return;
+    }
+    event=&mEvents[(mEventHead+mEventCount)%XT_CORO_EVENTS];
+    event->Type=type;
+    event->Id=id;
+    event->Value=value;
+    mEventCount++;
+}
+
+// Passes on posted events one at a time, running every task that can run after each,
+// until they are all waiting again
+// Everything the tasks send in a round is packed into one batch
+void XTouchSurface::Run() {
+    xt_wait_node_t *node;
+    xt_event_t event;
+    int flushed;
+
+    if (mRunning) return;
+    mRunning=1;
+    do {
+        mBoard->BeginBatch();
+        while (1) {
+            // Tasks woken by an event go back to waiting before the next one is passed on,
+            // so they see every event rather than only the last of a burst
+            while (mReady) {
+                node=mReady;
+                mReady=node->Next;
+                if (!mReady) mReadyTail=NULL;
+                node->Handle.resume();
+            }
+            if (!mEventCount) break;
+            event=mEvents[mEventHead];
+            mEventHead=(mEventHead+1)%XT_CORO_EVENTS;
+            mEventCount--;
+            Dispatch(&event);
+        }
+        mBoard->EndBatch();
+
+        // Output has now gone to the scheduler (or straight out)
+        flushed=0;
+        if ((mFlushing)&&((!mScheduler)||(mScheduler->Pending()==0))) {
+            while (mFlushing) {
+                node=mFlushing;
+                mFlushing=node->Next;
+                MakeReady(node);
+            }
+            flushed=1;
+        }
+    } while (flushed);
+    mRunning=0;
+}
+
+// Returns the number of tasks that haven't finished
+int XTouchSurface::Tasks() {
+    return mTasks;
+}
+
+XTouch *XTouchSurface::Board() {
+    return mBoard;
+}
+
+// Waits for the next event of the given types (XT_EVENT_ values or'd together)
+// and, unless id is -1, for the given button, fader or dial
+XTouchEventAwaiter XTouchSurface::NextEvent(int types, int id) {
+    return XTouchEventAwaiter(this,types,id,-1);
+}
+
+XTouchEventAwaiter XTouchSurface::ButtonPressed(int button) {
+    return XTouchEventAwaiter(this,XT_EVENT_BUTTON,button,1);
+}
+
+XTouchEventAwaiter XTouchSurface::FaderTouched(int fader) {
+    return XTouchEventAwaiter(this,XT_EVENT_TOUCH,fader,1);
+}
+
+XTouchEventAwaiter XTouchSurface::FaderReleased(int fader) {
+    return XTouchEventAwaiter(this,XT_EVENT_TOUCH,fader,0);
+}
+
+// Waits until everything sent so far has gone to the X-Touch
+XTouchFlushAwaiter XTouchSurface::Flush() {
+    return XTouchFlushAwaiter(this);
+}
+
+void XTouchSurface::ButtonHandler(void *surface, unsigned char button, int value) {
+    ((XTouchSurface *)surface)->Post(XT_EVENT_BUTTON,button,value);
+}
+
+void XTouchSurface::FaderHandler(void *surface, unsigned char fader, int value) {
+    ((XTouchSurface *)surface)->Post(XT_EVENT_FADER,fader,value);
+}
+
+void XTouchSurface::FaderStateHandler(void *surface, unsigned char fader, int value) {
+    ((XTouchSurface *)surface)->Post(XT_EVENT_TOUCH,fader,value);
+}
+
+void XTouchSurface::DialHandler(void *surface, unsigned char dial, int value) {
+    ((XTouchSurface *)surface)->Post(XT_EVENT_DIAL,dial,value);
+}
+
+// ----------------------------------------------------------------------------------------------
+// Private functions
+// ----------------------------------------------------------------------------------------------
+
+void XTouchSurface::Wait(xt_wait_node_t *node) {
+    if (node->Types) {
+        node->Next=mWaiting;
+        mWaiting=node;
+    } else {
+        node->Next=mFlushing;
+        mFlushing=node;
+    }
+}
+
+void XTouchSurface::MakeReady(xt_wait_node_t *node) {
+    node->Next=NULL;
+    if (mReadyTail) {
+        mReadyTail->Next=node;
+    } else {
+        mReady=node;
+    }
+    mReadyTail=node;
+}
+
+// Every task waiting for the event gets it
+void XTouchSurface::Dispatch(xt_event_t *event) {
+    xt_wait_node_t **link=&mWaiting;
+    xt_wait_node_t *node;
+    while (*link) {
+        node=*link;
+        if ((node->Types&event->Type)&&((node->Id<0)||(node->Id==event->Id))&&((node->Value<0)||(node->Value==event->Value))) {
+            *link=node->Next;
+            node->Event=*event;
+            MakeReady(node);
+        } else {
+            link=&node->Next;
+        }
+    }
+}
+
+void XTouchSurface::Finished(std::coroutine_handle<> handle) {
+    mTasks--;
+    handle.destroy();
+}
@@ -0,0 +1,193 @@
+/* ----------------------------------------------------------------
+                   x-touch-xctl library - coroutines.
+   Lets interactions with the X-Touch be written as C++20 coroutines
+   that wait for the events they need, e.g. wait for a fader to be
+   touched, follow it until it is let go, then act on where it was
+   left. Any number of these run on the one thread handling the
+   X-Touch.
+   ---------------------------------------------------------------- */
+
+/*
+MIT License
+
+Copyright (c) 2020 Martin Whitaker
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+/* Events from the XTouch callbacks are passed to Post(), and Run() then resumes
+   every task waiting for them. Run() must also be called after XTouchScheduler::Pump()
+   for Flush() to finish. Tasks only run inside Run(), so they never run at the same
+   time as each other or as the callbacks.
+
+   Each task's coroutine frame is allocated once when it is created. Awaiting doesn't
+   allocate: the awaiter, which lives in the frame, is linked into the surface's list
+   of waiters until its event comes.
+
+   Usage:
+     XTouchTask Follow(XTouchSurface &surface, int fader) {
+         xt_event_t event;
+         while (1) {
+             co_await surface.FaderTouched(fader);
+             do {
+                 event=co_await surface.NextEvent(XT_EVENT_FADER|XT_EVENT_TOUCH,fader);
+             } while (event.Type!=XT_EVENT_TOUCH);
+             ... commit the level
+             co_await surface.Flush();
+         }
+     }
+
+     XTouchSurface surface(&board,&scheduler);
+     surface.Spawn(Follow(surface,0));
+     ... from the fader callback: surface.Post(XT_EVENT_FADER,fader,value);
+     ... after each packet: surface.Run();
+*/
+
+#ifndef X_TOUCH_CORO_H
+#define X_TOUCH_CORO_H
+
+#include <coroutine>
+#include "x-touch.h"
+#include "x-touch-scheduler.h"
+
+#define XT_CORO_EVENTS 256          // Events that can be posted before Run() is called
+
+// Event types are bits so that awaiters can wait for more than one
+enum xt_event_type_t { XT_EVENT_BUTTON=1, XT_EVENT_FADER=2, XT_EVENT_TOUCH=4, XT_EVENT_DIAL=8, XT_EVENT_ANY=15 };
+
+typedef struct {
+    xt_event_type_t Type;
+    int Id;                         // Button, fader or dial number
+    int Value;                      // As passed to the XTouch callback
+} xt_event_t;
+
+// A task waiting on the surface, kept in the awaiter or the task's promise
+typedef struct xt_wait_node_t {
+    struct xt_wait_node_t *Next;
+    std::coroutine_handle<> Handle;
+    int Types;                      // Events wanted, or 0 to wait for a flush
+    int Id;                         // -1 for any
+    int Value;                      // -1 for any
+    xt_event_t Event;               // The event that ended the wait
+} xt_wait_node_t;
+
+class XTouchSurface;
+
+// The return type of coroutines run by XTouchSurface::Spawn()
+class XTouchTask {
+    public:
+        struct promise_type {
+            XTouchSurface *Surface;
+            xt_wait_node_t Start;
+            struct xt_final_awaiter_t {
+                bool await_ready() noexcept { return false; }
+                void await_suspend(std::coroutine_handle<promise_type> handle) noexcept;
+                void await_resume() noexcept { }
+            };
+            XTouchTask get_return_object() { return XTouchTask(std::coroutine_handle<promise_type>::from_promise(*this)); }
+            std::suspend_always initial_suspend() noexcept { return {}; }
+            xt_final_awaiter_t final_suspend() noexcept { return {}; }
+            void return_void() { }
+            void unhandled_exception();
+        };
+
+        XTouchTask(XTouchTask &&other) noexcept;
+        ~XTouchTask();
+
+    private:
+        friend class XTouchSurface;
+        explicit XTouchTask(std::coroutine_handle<promise_type> handle);
+        XTouchTask(const XTouchTask &)=delete;
+        XTouchTask &operator=(const XTouchTask &)=delete;
+
+        std::coroutine_handle<promise_type> mHandle;
+};
+
+class XTouchEventAwaiter {
+    public:
+        XTouchEventAwaiter(XTouchSurface *surface, int types, int id, int value);
+        bool await_ready() { return false; }
+        void await_suspend(std::coroutine_handle<> handle);
+        xt_event_t await_resume() { return mNode.Event; }
+
+    private:
+        XTouchSurface *mSurface;
+        xt_wait_node_t mNode;
+};
+
+class XTouchFlushAwaiter {
+    public:
+        XTouchFlushAwaiter(XTouchSurface *surface);
+        bool await_ready() { return false; }
+        void await_suspend(std::coroutine_handle<> handle);
+        void await_resume() { }
+
+    private:
+        XTouchSurface *mSurface;
+        xt_wait_node_t mNode;
+};
+
+class XTouchSurface {
+    public:
+        XTouchSurface(XTouch *board, XTouchScheduler *scheduler=NULL);
+        ~XTouchSurface();
+
+        void Spawn(XTouchTask task);
+        void Post(xt_event_type_t type, int id, int value);
+        void Run();
+        int Tasks();
+        XTouch *Board();
+
+        XTouchEventAwaiter NextEvent(int types=XT_EVENT_ANY, int id=-1);
+        XTouchEventAwaiter ButtonPressed(int button);
+        XTouchEventAwaiter FaderTouched(int fader);
+        XTouchEventAwaiter FaderReleased(int fader);
+        XTouchFlushAwaiter Flush();
+
+        // For registering straight with the XTouch, with the surface as the user pointer
+        static void ButtonHandler(void *surface, unsigned char button, int value);
+        static void FaderHandler(void *surface, unsigned char fader, int value);
+        static void FaderStateHandler(void *surface, unsigned char fader, int value);
+        static void DialHandler(void *surface, unsigned char dial, int value);
+
+    private:
+        friend class XTouchTask;
+        friend class XTouchEventAwaiter;
+        friend class XTouchFlushAwaiter;
+
+        void Wait(xt_wait_node_t *node);
+        void MakeReady(xt_wait_node_t *node);
+        void Dispatch(xt_event_t *event);
+        void Finished(std::coroutine_handle<> handle);
+
+        XTouch *mBoard;
+        XTouchScheduler *mScheduler;
+        xt_wait_node_t *mWaiting;       // Waiting for events
+        xt_wait_node_t *mFlushing;      // Waiting for output to go
+        xt_wait_node_t *mReady;         // To be resumed, in order
+        xt_wait_node_t *mReadyTail;
+        xt_event_t mEvents[XT_CORO_EVENTS];
+        int mEventHead;
+        int mEventCount;
+        int mTasks;
+        int mRunning;
+        unsigned int mOverflows;
+};
+
+#endif
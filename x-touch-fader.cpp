@@ -0,0 +1,452 @@
+/* ----------------------------------------------------------------
+                   x-touch-xctl library - fader law.
+   Converts between fader positions (as used by SetFaderLevel and
+   passed to the fader callback), dB and linear gain, following a
+   taper curve. Batch versions convert a whole bank at once using
+   AVX2 where the CPU has it.
+   ---------------------------------------------------------------- */
+
+
+/*
+MIT License
+
+Copyright (c) 2020 Martin Whitaker
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#include "x-touch-fader.h"
+#include <stdio.h>
+#include <math.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define XT_FADER_X86
+#endif
+
+static const xt_fader_point_t ConsoleTaper[] = {
+    {1,-80}, {2048,-50}, {4096,-30}, {6400,-20}, {8960,-10}, {10880,-5}, {XT_FADER_UNITY,0}, {14592,5}, {XT_FADER_MAX,10}
+};
+static const xt_fader_point_t DbTaper[] = {
+    {1,-60}, {XT_FADER_UNITY,0}, {XT_FADER_MAX,10}
+};
+
+#define LOG2_10_OVER_20 0.166096404744f     // dB to log2(gain)
+#define DB_PER_LOG2 6.02059991328f          // 20*log10(2)
+#define SILENT_GAIN 1e-10f                  // -200dB
+
+// 2^f for -0.5 <= f <= 0.5, Taylor series of e^(f ln 2)
+#define EXP2_C1 0.693147180560f
+#define EXP2_C2 0.240226506959f
+#define EXP2_C3 0.0555041086648f
+#define EXP2_C4 0.00961812910763f
+#define EXP2_C5 0.00133335581464f
+#define EXP2_C6 0.000154035303934f
+#define EXP2_C7 0.0000152527338040f
+
+// ----------------------------------------------------------------------------------------------
+// Batch kernels. The scalar versions of each are the single conversions below
+// ----------------------------------------------------------------------------------------------
+
+#ifdef XT_FADER_X86
+
+__attribute__((target("avx2")))
+static void LookupAvx2(const float *table, const int *positions, float *out, int n) {
+    const __m256i zero=_mm256_setzero_si256();
+    const __m256i top=_mm256_set1_epi32(XT_FADER_MAX);
+    __m256i p;
+    int i;
+    for(i=0;i+8<=n;i+=8) {
+        p=_mm256_loadu_si256((const __m256i*)(positions+i));
+        p=_mm256_min_epi32(_mm256_max_epi32(p,zero),top);
+        _mm256_storeu_ps(out+i,_mm256_i32gather_ps(table,p,4));
+    }
+    for(;i<n;i++) {
+        out[i]=table[(positions[i]<0)?0:(positions[i]>XT_FADER_MAX)?XT_FADER_MAX:positions[i]];
+    }
+}
+
+__attribute__((target("avx2")))
+static int InterpolateAvx2(const float *table, float mindb, float scale, const float *db, int *positions, int n) {
+    const __m256 vmin=_mm256_set1_ps(mindb);
+    const __m256 vscale=_mm256_set1_ps(scale);
+    const __m256 vzero=_mm256_setzero_ps();
+    const __m256 vsteps=_mm256_set1_ps(XT_FADER_DB_STEPS);
+    const __m256 vlast=_mm256_set1_ps(XT_FADER_DB_STEPS-1);
+    const __m256 vhalf=_mm256_set1_ps(0.5f);
+    const __m256i one=_mm256_set1_epi32(1);
+    __m256 d,f,fi,t0,t1,p,below;
+    __m256i i0;
+    int i;
+    for(i=0;i+8<=n;i+=8) {
+        d=_mm256_loadu_ps(db+i);
+        below=_mm256_cmp_ps(d,vmin,_CMP_LT_OQ);
+        f=_mm256_mul_ps(_mm256_sub_ps(d,vmin),vscale);
+        f=_mm256_min_ps(_mm256_max_ps(f,vzero),vsteps);
+        i0=_mm256_cvttps_epi32(_mm256_min_ps(f,vlast));
+        fi=_mm256_cvtepi32_ps(i0);
+        t0=_mm256_i32gather_ps(table,i0,4);
+        t1=_mm256_i32gather_ps(table,_mm256_add_epi32(i0,one),4);
+        p=_mm256_add_ps(t0,_mm256_mul_ps(_mm256_sub_ps(t1,t0),_mm256_sub_ps(f,fi)));
+        p=_mm256_andnot_ps(below,_mm256_add_ps(p,vhalf));
+        _mm256_storeu_si256((__m256i*)(positions+i),_mm256_cvttps_epi32(p));
+    }
+    return i;
+}
+
+__attribute__((target("avx2")))
+static int DbToGainAvx2(const float *db, float *gains, int n) {
+    const __m256 vscale=_mm256_set1_ps(LOG2_10_OVER_20);
+    const __m256 voff=_mm256_set1_ps(XT_FADER_OFF_DB);
+    const __m256 vlo=_mm256_set1_ps(-126);
+    const __m256 vhi=_mm256_set1_ps(127);
+    __m256 x,r,f,p,off;
+    __m256i e;
+    int i;
+    for(i=0;i+8<=n;i+=8) {
+        x=_mm256_loadu_ps(db+i);
+        off=_mm256_cmp_ps(x,voff,_CMP_LE_OQ);
+        x=_mm256_min_ps(_mm256_max_ps(_mm256_mul_ps(x,vscale),vlo),vhi);
+        r=_mm256_round_ps(x,_MM_FROUND_TO_NEAREST_INT|_MM_FROUND_NO_EXC);
+        f=_mm256_sub_ps(x,r);
+        p=_mm256_set1_ps(EXP2_C7);
+        p=_mm256_add_ps(_mm256_mul_ps(p,f),_mm256_set1_ps(EXP2_C6));
+        p=_mm256_add_ps(_mm256_mul_ps(p,f),_mm256_set1_ps(EXP2_C5));
+        p=_mm256_add_ps(_mm256_mul_ps(p,f),_mm256_set1_ps(EXP2_C4));
+        p=_mm256_add_ps(_mm256_mul_ps(p,f),_mm256_set1_ps(EXP2_C3));
+        p=_mm256_add_ps(_mm256_mul_ps(p,f),_mm256_set1_ps(EXP2_C2));
+        p=_mm256_add_ps(_mm256_mul_ps(p,f),_mm256_set1_ps(EXP2_C1));
+        p=_mm256_add_ps(_mm256_mul_ps(p,f),_mm256_set1_ps(1.0f));
+        // Multiply by 2^r by adding r to the exponent
+        e=_mm256_slli_epi32(_mm256_cvtps_epi32(r),23);
+        p=_mm256_castsi256_ps(_mm256_add_epi32(_mm256_castps_si256(p),e));
+        _mm256_storeu_ps(gains+i,_mm256_andnot_ps(off,p));
+    }
+    return i;
+}
+
+__attribute__((target("avx2")))
+static int GainToDbAvx2(const float *gains, float *db, int n) {
+    const __m256 vsilent=_mm256_set1_ps(SILENT_GAIN);
+    const __m256 voff=_mm256_set1_ps(XT_FADER_OFF_DB);
+    const __m256 vsqrt2=_mm256_set1_ps(1.41421356237f);
+    const __m256 vone=_mm256_set1_ps(1.0f);
+    const __m256 vhalf=_mm256_set1_ps(0.5f);
+    const __m256i mantissa=_mm256_set1_epi32(0x007fffff);
+    const __m256i bias=_mm256_set1_epi32(127);
+    __m256 g,m,t,t2,l,silent,big;
+    __m256i bits,e;
+    int i;
+    for(i=0;i+8<=n;i+=8) {
+        g=_mm256_loadu_ps(gains+i);
+        silent=_mm256_cmp_ps(g,vsilent,_CMP_LE_OQ);
+        g=_mm256_max_ps(g,vsilent);
+        bits=_mm256_castps_si256(g);
+        e=_mm256_sub_epi32(_mm256_srli_epi32(bits,23),bias);
+        m=_mm256_castsi256_ps(_mm256_or_si256(_mm256_and_si256(bits,mantissa),_mm256_castps_si256(vone)));
+        // Keep the mantissa between sqrt(0.5) and sqrt(2) so the series converges quickly
+        big=_mm256_cmp_ps(m,vsqrt2,_CMP_GT_OQ);
+        m=_mm256_blendv_ps(m,_mm256_mul_ps(m,vhalf),big);
+        e=_mm256_sub_epi32(e,_mm256_castps_si256(big));
+        // ln(m) = 2*atanh((m-1)/(m+1))
+        t=_mm256_div_ps(_mm256_sub_ps(m,vone),_mm256_add_ps(m,vone));
+        t2=_mm256_mul_ps(t,t);
+        l=_mm256_set1_ps(1.0f/9);
+        l=_mm256_add_ps(_mm256_mul_ps(l,t2),_mm256_set1_ps(1.0f/7));
+        l=_mm256_add_ps(_mm256_mul_ps(l,t2),_mm256_set1_ps(1.0f/5));
+        l=_mm256_add_ps(_mm256_mul_ps(l,t2),_mm256_set1_ps(1.0f/3));
+        l=_mm256_add_ps(_mm256_mul_ps(l,t2),vone);
+        l=_mm256_mul_ps(l,_mm256_mul_ps(t,_mm256_set1_ps(2.0f/0.69314718056f)));
+        l=_mm256_mul_ps(_mm256_add_ps(l,_mm256_cvtepi32_ps(e)),_mm256_set1_ps(DB_PER_LOG2));
+        _mm256_storeu_ps(db+i,_mm256_blendv_ps(l,voff,silent));
+    }
+    return i;
+}
+
+static int HaveAvx2() {
+    static int avx2=-1;
+    if (avx2<0) {
+        __builtin_cpu_init();
+        avx2=__builtin_cpu_supports("avx2")?1:0;
+    }
+    return avx2;
+}
+
+#else
+
+static int HaveAvx2() {
+    return 0;
+}
+
+#endif
+
+// ----------------------------------------------------------------------------------------------
+// Public interfaces
+// ----------------------------------------------------------------------------------------------
+
+XTouchFaderLaw::XTouchFaderLaw(xt_taper_t taper) {
+    mPositionDb=new float[XT_FADER_MAX+1];
+    mPositionGain=new float[XT_FADER_MAX+1];
+    mDbPosition=new float[XT_FADER_DB_STEPS+1];
+    mSimd=1;
+    SetTaper(taper);
+}
+
+XTouchFaderLaw::~XTouchFaderLaw() {
+    delete[] mPositionDb;
+    delete[] mPositionGain;
+    delete[] mDbPosition;
+}
+
+void XTouchFaderLaw::SetTaper(xt_taper_t taper) {
+    switch (taper) {
+        case XT_TAPER_DB: BuildTables(DbTaper,sizeof(DbTaper)/sizeof(DbTaper[0]),0); break;
+        case XT_TAPER_GAIN: BuildTables(NULL,0,1); break;
+        default: BuildTables(ConsoleTaper,sizeof(ConsoleTaper)/sizeof(ConsoleTaper[0]),0); break;
+    }
+}
+
+// Sets a taper passing through 2 to XT_FADER_MAX_POINTS points, with straight lines in dB between them
+// Positions and dB must both go up from point to point, with positions from 1 to XT_FADER_MAX
+// Positions before the first point or after the last are the same dB as that point
+// Returns 0 and leaves the taper alone if the points aren't usable
+int XTouchFaderLaw::SetTaperPoints(const xt_fader_point_t *points, int count) {
+    int i;
+    if ((count<2)||(count>XT_FADER_MAX_POINTS)) {
+        printf("Fader taper needs 2 to %d points\n",XT_FADER_MAX_POINTS);
+        return 0;
+    }
+    for(i=0;i<count;i++) {
+        if ((points[i].Position<1)||(points[i].Position>XT_FADER_MAX)||(points[i].Db<=XT_FADER_OFF_DB)||
+            ((i>0)&&((points[i].Position<=points[i-1].Position)||(points[i].Db<=points[i-1].Db)))) {
+            printf("Fader taper point %d (%d,%g) out of order or range\n",i,points[i].Position,points[i].Db);
+            return 0;
+        }
+    }
+    BuildTables(points,count,0);
+    return 1;
+}
+
+// Batch conversions use AVX2 if the CPU has it, unless turned off here (e.g. to compare speeds)
+void XTouchFaderLaw::SetSimd(int enable) {
+    mSimd=enable;
+}
+
+// dB at position 1, the lowest above off
+float XTouchFaderLaw::MinDb() {
+    return mMinDb;
+}
+
+// dB at the top of the fader
+float XTouchFaderLaw::MaxDb() {
+    return mMaxDb;
+}
+
+float XTouchFaderLaw::PositionToDb(int position) {
+    if (position<0) position=0;
+    if (position>XT_FADER_MAX) position=XT_FADER_MAX;
+    return mPositionDb[position];
+}
+
+float XTouchFaderLaw::PositionToGain(int position) {
+    if (position<0) position=0;
+    if (position>XT_FADER_MAX) position=XT_FADER_MAX;
+    return mPositionGain[position];
+}
+
+// Returns the nearest position. Anything below MinDb() is off (position 0)
+int XTouchFaderLaw::DbToPosition(float db) {
+    float f;
+    int i;
+    if (db<mMinDb) return 0;
+    f=(db-mMinDb)*mDbScale;
+    if (f>XT_FADER_DB_STEPS) f=XT_FADER_DB_STEPS;
+    i=(int)((f<XT_FADER_DB_STEPS-1)?f:XT_FADER_DB_STEPS-1);
+    return (int)(mDbPosition[i]+(mDbPosition[i+1]-mDbPosition[i])*(f-i)+0.5f);
+}
+
+int XTouchFaderLaw::GainToPosition(float gain) {
+    return DbToPosition(GainToDb(gain));
+}
+
+// XT_FADER_OFF_DB or below gives a gain of 0
+float XTouchFaderLaw::DbToGain(float db) {
+    float x;
+    float r;
+    float f;
+    float p;
+    if (db<=XT_FADER_OFF_DB) return 0;
+    x=db*LOG2_10_OVER_20;
+    if (x<-126) x=-126;
+    if (x>127) x=127;
+    r=rintf(x);
+    f=x-r;
+    p=((((((EXP2_C7*f+EXP2_C6)*f+EXP2_C5)*f+EXP2_C4)*f+EXP2_C3)*f+EXP2_C2)*f+EXP2_C1)*f+1.0f;
+    return ldexpf(p,(int)r);
+}
+
+// A gain of 0 (or -200dB and below) gives XT_FADER_OFF_DB
+float XTouchFaderLaw::GainToDb(float gain) {
+    union { float f; unsigned int u; } bits;
+    int e;
+    float m;
+    float t;
+    float t2;
+    float l;
+    if (gain<=SILENT_GAIN) return XT_FADER_OFF_DB;
+    bits.f=gain;
+    e=(int)(bits.u>>23)-127;
+    bits.u=(bits.u&0x007fffff)|0x3f800000;
+    m=bits.f;
+    if (m>1.41421356237f) {
+        m*=0.5f;
+        e++;
+    }
+    t=(m-1.0f)/(m+1.0f);
+    t2=t*t;
+    l=((((1.0f/9)*t2+(1.0f/7))*t2+(1.0f/5))*t2+(1.0f/3))*t2+1.0f;
+    l=l*(t*(2.0f/0.69314718056f));
+    return (l+e)*DB_PER_LOG2;
+}
+
+// Converts n positions, e.g. a bank of faders, to dB
+void XTouchFaderLaw::PositionsToDb(const int *positions, float *db, int n) {
+    int i;
+#ifdef XT_FADER_X86
+    if (mSimd&&HaveAvx2()) {
+        LookupAvx2(mPositionDb,positions,db,n);
+        return;
+    }
+#endif
+    for(i=0;i<n;i++) {
+        db[i]=PositionToDb(positions[i]);
+    }
+}
+
+void XTouchFaderLaw::PositionsToGain(const int *positions, float *gains, int n) {
+    int i;
+#ifdef XT_FADER_X86
+    if (mSimd&&HaveAvx2()) {
+        LookupAvx2(mPositionGain,positions,gains,n);
+        return;
+    }
+#endif
+    for(i=0;i<n;i++) {
+        gains[i]=PositionToGain(positions[i]);
+    }
+}
+
+void XTouchFaderLaw::DbToPositions(const float *db, int *positions, int n) {
+    int i=0;
+#ifdef XT_FADER_X86
+    if (mSimd&&HaveAvx2()) i=InterpolateAvx2(mDbPosition,mMinDb,mDbScale,db,positions,n);
+#endif
+    for(;i<n;i++) {
+        positions[i]=DbToPosition(db[i]);
+    }
+}
+
+void XTouchFaderLaw::GainToPositions(const float *gains, int *positions, int n) {
+    float db[64];
+    int i;
+    int len;
+    for(i=0;i<n;i+=64) {
+        len=(n-i<64)?n-i:64;
+        GainsToDb(gains+i,db,len);
+        DbToPositions(db,positions+i,len);
+    }
+}
+
+void XTouchFaderLaw::DbToGains(const float *db, float *gains, int n) {
+    int i=0;
+#ifdef XT_FADER_X86
+    if (mSimd&&HaveAvx2()) i=DbToGainAvx2(db,gains,n);
+#endif
+    for(;i<n;i++) {
+        gains[i]=DbToGain(db[i]);
+    }
+}
+
+void XTouchFaderLaw::GainsToDb(const float *gains, float *db, int n) {
+    int i=0;
+#ifdef XT_FADER_X86
+    if (mSimd&&HaveAvx2()) i=GainToDbAvx2(gains,db,n);
+#endif
+    for(;i<n;i++) {
+        db[i]=GainToDb(gains[i]);
+    }
+}
+
+// ----------------------------------------------------------------------------------------------
+// Private functions
+// ----------------------------------------------------------------------------------------------
+
+// With gainlaw set the gain is in proportion to the position, otherwise the points give the taper
+void XTouchFaderLaw::BuildTables(const xt_fader_point_t *points, int count, int gainlaw) {
+    int position;
+    int segment=0;
+    int low;
+    int high;
+    int mid;
+    int i;
+    float db;
+
+    mPositionDb[0]=XT_FADER_OFF_DB;
+    mPositionGain[0]=0;
+    for(position=1;position<=XT_FADER_MAX;position++) {
+        if (gainlaw) {
+            db=20*log10((double)position/XT_FADER_UNITY);
+        } else if (position<=points[0].Position) {
+            db=points[0].Db;
+        } else if (position>=points[count-1].Position) {
+            db=points[count-1].Db;
+        } else {
+            while (position>points[segment+1].Position) segment++;
+            db=points[segment].Db+(points[segment+1].Db-points[segment].Db)*
+               (position-points[segment].Position)/(points[segment+1].Position-points[segment].Position);
+        }
+        mPositionDb[position]=db;
+        mPositionGain[position]=pow(10.0,db/20.0);
+    }
+    mMinDb=mPositionDb[1];
+    mMaxDb=mPositionDb[XT_FADER_MAX];
+    mDbScale=XT_FADER_DB_STEPS/(mMaxDb-mMinDb);
+
+    // The fractional position for evenly spaced dB, found in the table above
+    for(i=0;i<=XT_FADER_DB_STEPS;i++) {
+        db=mMinDb+i/mDbScale;
+        low=1;
+        high=XT_FADER_MAX;
+        while (high-low>1) {
+            mid=(low+high)/2;
+            if (mPositionDb[mid]<=db) {
+                low=mid;
+            } else {
+                high=mid;
+            }
+        }
+        if ((db<=mPositionDb[low])||(mPositionDb[high]<=mPositionDb[low])) {
+            mDbPosition[i]=low;
+        } else if (db>=mPositionDb[high]) {
+            mDbPosition[i]=high;
+        } else {
+            mDbPosition[i]=low+(db-mPositionDb[low])/(mPositionDb[high]-mPositionDb[low]);
+        }
+    }
+}
@@ -0,0 +1,109 @@
+/* ----------------------------------------------------------------
+                   x-touch-xctl library - fader law.
+   Converts between fader positions (as used by SetFaderLevel and
+   passed to the fader callback), dB and linear gain, following a
+   taper curve. Batch versions convert a whole bank at once using
+   AVX2 where the CPU has it.
+   ---------------------------------------------------------------- */
+
+/*
+MIT License
+
+Copyright (c) 2020 Martin Whitaker
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+/* Positions run from 0 (off, -infinity dB) to XT_FADER_MAX, with 0dB at
+   XT_FADER_UNITY for the built in tapers. -infinity dB is given as XT_FADER_OFF_DB
+   so it can be used in arithmetic, and a gain of 0.
+
+   Position to dB and gain are looked up in tables built for the taper. dB to
+   position interpolates a table evenly spaced in dB, and dB to gain and back use
+   polynomials, all to well within a fader position or 0.001dB.
+
+   Custom tapers are given as a list of points the curve passes through, with
+   straight lines in dB between them, e.g. the console taper is:
+     {1,-80} {2048,-50} {4096,-30} {6400,-20} {8960,-10} {10880,-5} {12800,0} {14592,5} {16383,10}
+
+   Usage:
+     XTouchFaderLaw law;
+     law.PositionToDb(12800)         0.0
+     law.DbToPosition(-10)           8960
+     law.PositionsToGain(levels,gains,8);
+*/
+
+#ifndef X_TOUCH_FADER_H
+#define X_TOUCH_FADER_H
+
+#define XT_FADER_MAX 16383
+#define XT_FADER_UNITY 12800
+#define XT_FADER_OFF_DB -200.0f
+#define XT_FADER_MAX_POINTS 16
+#define XT_FADER_DB_STEPS 16384     // Size of the dB to position table
+
+enum xt_taper_t {
+    XT_TAPER_CONSOLE,               // Like the markings on a mixing desk, -80dB to +10dB
+    XT_TAPER_DB,                    // Even in dB, -60dB to 0dB then 0dB to +10dB
+    XT_TAPER_GAIN                   // Gain in proportion to position, +2.1dB at the top
+};
+
+typedef struct {
+    int Position;
+    float Db;
+} xt_fader_point_t;
+
+class XTouchFaderLaw {
+    public:
+        XTouchFaderLaw(xt_taper_t taper=XT_TAPER_CONSOLE);
+        ~XTouchFaderLaw();
+
+        void SetTaper(xt_taper_t taper);
+        int SetTaperPoints(const xt_fader_point_t *points, int count);
+        void SetSimd(int enable);
+        float MinDb();
+        float MaxDb();
+
+        float PositionToDb(int position);
+        float PositionToGain(int position);
+        int DbToPosition(float db);
+        int GainToPosition(float gain);
+        static float DbToGain(float db);
+        static float GainToDb(float gain);
+
+        void PositionsToDb(const int *positions, float *db, int n);
+        void PositionsToGain(const int *positions, float *gains, int n);
+        void DbToPositions(const float *db, int *positions, int n);
+        void GainToPositions(const float *gains, int *positions, int n);
+        void DbToGains(const float *db, float *gains, int n);
+        void GainsToDb(const float *gains, float *db, int n);
+
+    private:
+        void BuildTables(const xt_fader_point_t *points, int count, int gainlaw);
+
+        float *mPositionDb;         // XT_FADER_MAX+1 entries
+        float *mPositionGain;       // XT_FADER_MAX+1 entries
+        float *mDbPosition;         // XT_FADER_DB_STEPS+1 entries
+        float mMinDb;
+        float mMaxDb;
+        float mDbScale;
+        int mSimd;
+};
+
+#endif
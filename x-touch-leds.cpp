@@ -0,0 +1,331 @@
+/* ----------------------------------------------------------------
+                   x-touch-xctl library - LED compositor.
+   Owns the button lights and dial rings, drawing animations (blinks
+   at any rate, attention patterns, chases and meters on the rings)
+   in layers over their normal state, and sending only the LEDs
+   that have changed, packed into one message each time.
+   ---------------------------------------------------------------- */
+
+
+/*
+MIT License
+
+Copyright (c) 2020 Martin Whitaker
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#include "x-touch-leds.h"
+#include <stdio.h>
+#include <string.h>
+
+// ----------------------------------------------------------------------------------------------
+// Public interfaces
+// ----------------------------------------------------------------------------------------------
+
+XTouchLeds::XTouchLeds(XTouch *board) {
+    int i;
+    mBoard=board;
+    mTicks=0;
+    mOrder=0;
+    for(i=0;i<XT_LEDS_BUTTONS;i++) {
+        mBaseButtons[i]=OFF;
+        mButtons[i]=OFF;
+        mSentButtons[i]=OFF;
+    }
+    for(i=0;i<8;i++) {
+        mBaseRings[i]=0;
+        mRings[i]=0;
+        mSentRings[i]=0;
+    }
+    memset(mAnimations,0,sizeof(mAnimations));
+}
+
+XTouchLeds::~XTouchLeds() {
+
+}
+
+// Sets the normal state of a button's light (0 to 115)
+void XTouchLeds::SetButton(int button, xt_button_state_t state) {
+    if ((button<0)||(button>=XT_LEDS_BUTTONS)||(state>ON)) return;
+    mBaseButtons[button]=state;
+}
+
+// Sets the normal state of a dial's ring (0 to 7) as a mask of LEDs, e.g. from PanRing() or LevelRing()
+void XTouchLeds::SetRing(int ring, unsigned int leds) {
+    if ((ring<0)||(ring>7)) return;
+    mBaseRings[ring]=leds&((1<<XT_LEDS_RING_SIZE)-1);
+}
+
+// A single LED showing a pan position from -6 to 6 (as XTouch::SetDialPan)
+unsigned int XTouchLeds::PanRing(int position) {
+    if (position<-6) position=-6;
+    if (position>6) position=6;
+    return 1<<(position+6);
+}
+
+// A bar of level LEDs, 0 to 13 (as XTouch::SetDialLevel)
+unsigned int XTouchLeds::LevelRing(int level) {
+    if (level<0) level=0;
+    if (level>XT_LEDS_RING_SIZE) level=XT_LEDS_RING_SIZE;
+    return (1<<level)-1;
+}
+
+// The following start animations and return an ID for them, or 0 if too many are running.
+// They run for ticks ticks, or until stopped if ticks is 0. An ID is only valid until its
+// animation stops
+
+// Buttons first to last light for on ticks out of every period. On a ring, what's under it blinks
+int XTouchLeds::Blink(int first, int last, int period, int on, int layer, int ticks) {
+    xt_led_animation_t animation;
+    memset(&animation,0,sizeof(animation));
+    animation.Effect=XT_LED_BLINK;
+    animation.First=first;
+    animation.Last=last;
+    animation.Period=(period>0)?period:1;
+    animation.On=on;
+    animation.Layer=layer;
+    animation.Ticks=ticks;
+    return Start(&animation);
+}
+
+// Buttons first to last follow pattern, a bit per tick (bit 0 first), repeating every steps ticks (up to 32)
+int XTouchLeds::Pattern(int first, int last, uint32_t pattern, int steps, int layer, int ticks) {
+    xt_led_animation_t animation;
+    memset(&animation,0,sizeof(animation));
+    animation.Effect=XT_LED_PATTERN;
+    animation.First=first;
+    animation.Last=last;
+    animation.Pattern=pattern;
+    animation.Steps=((steps>0)&&(steps<=32))?steps:32;
+    animation.Layer=layer;
+    animation.Ticks=ticks;
+    return Start(&animation);
+}
+
+// width lit LEDs run along buttons first to last, or round a ring, moving on every period ticks
+int XTouchLeds::Chase(int first, int last, int period, int width, int layer, int ticks) {
+    xt_led_animation_t animation;
+    memset(&animation,0,sizeof(animation));
+    animation.Effect=XT_LED_CHASE;
+    animation.First=first;
+    animation.Last=last;
+    animation.Period=(period>0)?period:1;
+    animation.On=(width>0)?width:1;
+    animation.Layer=layer;
+    animation.Ticks=ticks;
+    return Start(&animation);
+}
+
+// Shows SetLevel() on a ring as a bar, with the highest level held for hold ticks before it falls back
+int XTouchLeds::Meter(int ring, int hold, int layer) {
+    xt_led_animation_t animation;
+    memset(&animation,0,sizeof(animation));
+    animation.Effect=XT_LED_METER;
+    animation.First=ring;
+    animation.Last=ring;
+    animation.Hold=hold;
+    animation.Layer=layer;
+    return Start(&animation);
+}
+
+// level is 0 to 13
+void XTouchLeds::SetLevel(int id, int level) {
+    xt_led_animation_t *animation;
+    if ((id<1)||(id>XT_LEDS_ANIMATIONS)) return;
+    animation=&mAnimations[id-1];
+    if (animation->Effect!=XT_LED_METER) return;
+    if (level<0) level=0;
+    if (level>XT_LEDS_RING_SIZE) level=XT_LEDS_RING_SIZE;
+    animation->Level=level;
+    if (level>=animation->Peak) {
+        animation->Peak=level;
+        animation->PeakTimer=animation->Hold;
+    }
+}
+
+// The LEDs go back to whatever is underneath on the next Tick() or Update()
+void XTouchLeds::Stop(int id) {
+    if ((id<1)||(id>XT_LEDS_ANIMATIONS)) return;
+    mAnimations[id-1].Effect=XT_LED_NONE;
+}
+
+void XTouchLeds::StopAll() {
+    int i;
+    for(i=0;i<XT_LEDS_ANIMATIONS;i++) {
+        mAnimations[i].Effect=XT_LED_NONE;
+    }
+}
+
+int XTouchLeds::Running() {
+    int i;
+    int n=0;
+    for(i=0;i<XT_LEDS_ANIMATIONS;i++) {
+        if (mAnimations[i].Effect!=XT_LED_NONE) n++;
+    }
+    return n;
+}
+
+// Moves the animations on and sends whatever has changed
+void XTouchLeds::Tick() {
+    xt_led_animation_t *animation;
+    int i;
+
+    mTicks++;
+    for(i=0;i<XT_LEDS_ANIMATIONS;i++) {
+        animation=&mAnimations[i];
+        if (animation->Effect==XT_LED_NONE) continue;
+        if ((animation->Ticks>0)&&(mTicks-animation->Start>=(unsigned int)animation->Ticks)) {
+            animation->Effect=XT_LED_NONE;
+            continue;
+        }
+        if (animation->Effect==XT_LED_METER) {
+            if (animation->PeakTimer>0) {
+                animation->PeakTimer--;
+            } else if (animation->Peak>animation->Level) {
+                animation->Peak--;
+            }
+        }
+    }
+    Update();
+}
+
+// Sends the lights and rings that differ from the last frame sent, batched by kind
+void XTouchLeds::Update() {
+    int i;
+    int messages=0;
+
+    Compose();
+    for(i=0;i<XT_LEDS_BUTTONS;i++) {
+        if (mButtons[i]==mSentButtons[i]) continue;
+        if (messages==XT_LEDS_BATCH) {
+            mBoard->EndBatch();
+            messages=0;
+        }
+        if (messages==0) mBoard->BeginBatch();
+        messages++;
+        mSentButtons[i]=mButtons[i];
+        mBoard->SetSingleButton(i,mButtons[i]);
+    }
+    if (messages) mBoard->EndBatch();
+    messages=0;
+    // Each ring is two controllers
+    for(i=0;i<8;i++) {
+        if (mRings[i]==mSentRings[i]) continue;
+        if (messages==XT_LEDS_BATCH) {
+            mBoard->EndBatch();
+            messages=0;
+        }
+        if (messages==0) mBoard->BeginBatch();
+        messages+=2;
+        mSentRings[i]=mRings[i];
+        mBoard->SetDialLeds(i,mRings[i]);
+    }
+    if (messages) mBoard->EndBatch();
+}
+
+// ----------------------------------------------------------------------------------------------
+// Private functions
+// ----------------------------------------------------------------------------------------------
+
+int XTouchLeds::Start(xt_led_animation_t *animation) {
+    int i;
+    if ((animation->First>=XT_LED_RING(0))&&(animation->First<=XT_LED_RING(7))) {
+        animation->Last=animation->First;
+    } else if ((animation->Effect==XT_LED_METER)||(animation->First<0)||(animation->Last>=XT_LEDS_BUTTONS)||(animation->First>animation->Last)) {
+        return 0;
+    }
+    for(i=0;i<XT_LEDS_ANIMATIONS;i++) {
+        if (mAnimations[i].Effect!=XT_LED_NONE) continue;
+        animation->Start=mTicks;
+        animation->Order=mOrder++;
+        mAnimations[i]=*animation;
+        return i+1;
+    }
+    printf("LEDs: more than %d animations\n",XT_LEDS_ANIMATIONS);
+    return 0;
+}
+
+// Whether LED index of count is lit this tick
+int XTouchLeds::Lit(xt_led_animation_t *animation, int index, int count) {
+    unsigned int t=mTicks-animation->Start;
+    switch (animation->Effect) {
+        case XT_LED_BLINK:
+                return (int)(t%animation->Period)<animation->On;
+        case XT_LED_PATTERN:
+                return (animation->Pattern>>(t%animation->Steps))&1;
+        case XT_LED_CHASE:
+                return (index-(int)((t/animation->Period)%count)+count)%count<animation->On;
+        default:
+                return 0;
+    }
+}
+
+void XTouchLeds::Draw(xt_led_animation_t *animation) {
+    unsigned int leds;
+    int ring;
+    int i;
+
+    if (animation->First>=XT_LED_RING(0)) {
+        ring=animation->First-XT_LED_RING(0);
+        switch (animation->Effect) {
+            case XT_LED_METER:
+                    leds=LevelRing(animation->Level);
+                    if (animation->Peak>0) leds|=1<<(animation->Peak-1);
+                    break;
+            case XT_LED_CHASE:
+                    leds=0;
+                    for(i=0;i<XT_LEDS_RING_SIZE;i++) {
+                        if (Lit(animation,i,XT_LEDS_RING_SIZE)) leds|=1<<i;
+                    }
+                    break;
+            default:
+                    leds=Lit(animation,0,1)?mRings[ring]:0;
+                    break;
+        }
+        mRings[ring]=leds;
+        return;
+    }
+    for(i=animation->First;i<=animation->Last;i++) {
+        mButtons[i]=Lit(animation,i-animation->First,animation->Last-animation->First+1)?ON:OFF;
+    }
+}
+
+// Draws the animations over the normal state, lowest layer (then oldest) first
+void XTouchLeds::Compose() {
+    xt_led_animation_t *order[XT_LEDS_ANIMATIONS];
+    xt_led_animation_t *animation;
+    int count=0;
+    int i, j;
+
+    memcpy(mButtons,mBaseButtons,sizeof(mButtons));
+    memcpy(mRings,mBaseRings,sizeof(mRings));
+    for(i=0;i<XT_LEDS_ANIMATIONS;i++) {
+        animation=&mAnimations[i];
+        if (animation->Effect==XT_LED_NONE) continue;
+        for(j=count;(j>0)&&((order[j-1]->Layer>animation->Layer)||((order[j-1]->Layer==animation->Layer)&&(order[j-1]->Order>animation->Order)));j--) {
+            order[j]=order[j-1];
+        }
+        order[j]=animation;
+        count++;
+    }
+    for(i=0;i<count;i++) {
+        Draw(order[i]);
+    }
+}
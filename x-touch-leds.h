@@ -0,0 +1,137 @@
+/* ----------------------------------------------------------------
+                   x-touch-xctl library - LED compositor.
+   Owns the button lights and dial rings, drawing animations (blinks
+   at any rate, attention patterns, chases and meters on the rings)
+   in layers over their normal state, and sending only the LEDs
+   that have changed, packed into one message each time.
+   ---------------------------------------------------------------- */
+
+
+/*
+MIT License
+
+Copyright (c) 2020 Martin Whitaker
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+/* Set the normal state of the lights and rings here rather than on the XTouch.
+   Animations are drawn over it, highest layer last, and cover the LEDs they
+   are given for as long as they run. Buttons are 0 to 115 and the ring of dial
+   n is XT_LED_RING(n). Rings are 13 bit masks, LED 0 at the bottom left.
+
+   Call Tick() every XT_LEDS_TICK_MS to run the animations. Changes made with
+   SetButton() and SetRing() are sent on the next Tick(), or straight away by
+   calling Update(). Each frame is compared with the last and the changed
+   lights and rings are sent in batches (see XTouch::BeginBatch): button
+   notes and ring controllers in packets of their own, no more than
+   XT_LEDS_BATCH messages each, so an XTouchScheduler sends them with the
+   buttons and rings rather than behind full dumps.
+
+   Usage:
+     XTouchLeds leds(&board);
+     leds.SetButton(94,ON);
+     leds.SetRing(0,XTouchLeds::PanRing(-3));
+     id=leds.Blink(94,94,20,10);                          // Play blinks once a second
+     leds.Pattern(24,31,XT_LED_ATTENTION,XT_LED_ATTENTION_STEPS,2,40);  // Selects flash for 2 seconds
+     id=leds.Meter(XT_LED_RING(3),10);                    // Meter with a peak held for 10 ticks
+     leds.SetLevel(id,9);
+     leds.Update();
+     ... every 50ms: leds.Tick();
+*/
+
+#ifndef X_TOUCH_LEDS_H
+#define X_TOUCH_LEDS_H
+
+#include <stdint.h>
+#include "x-touch.h"
+
+#define XT_LEDS_TICK_MS 50
+#define XT_LEDS_ANIMATIONS 32       // Running at once
+#define XT_LEDS_BUTTONS 116
+#define XT_LEDS_RING_SIZE 13
+#define XT_LEDS_BATCH 16            // Messages per packet, within XT_SCHED_BATCH_MESSAGES
+#define XT_LED_RING(n) (128+(n))
+
+#define XT_LED_ATTENTION 0x05       // Double flash...
+#define XT_LED_ATTENTION_STEPS 16   // ...every 800ms
+
+enum xt_led_effect_t { XT_LED_NONE, XT_LED_BLINK, XT_LED_PATTERN, XT_LED_CHASE, XT_LED_METER };
+
+typedef struct {
+    xt_led_effect_t Effect;
+    int Layer;
+    int First;                      // Buttons First to Last, or a ring
+    int Last;
+    int Period;                     // Ticks per blink, or per step of a chase
+    int On;                         // Ticks lit per blink, or width of a chase
+    uint32_t Pattern;               // Bit per tick, bit 0 first
+    int Steps;
+    int Level;                      // Meter, 0 to 13
+    int Peak;
+    int Hold;
+    int PeakTimer;
+    int Ticks;                      // Ticks left to run, 0 until stopped
+    unsigned int Start;
+    unsigned int Order;             // Drawn in order of layer, then when started
+} xt_led_animation_t;
+
+class XTouchLeds {
+    public:
+        XTouchLeds(XTouch *board);
+        ~XTouchLeds();
+
+        void SetButton(int button, xt_button_state_t state);
+        void SetRing(int ring, unsigned int leds);
+        static unsigned int PanRing(int position);
+        static unsigned int LevelRing(int level);
+
+        int Blink(int first, int last, int period, int on, int layer=1, int ticks=0);
+        int Pattern(int first, int last, uint32_t pattern, int steps, int layer=1, int ticks=0);
+        int Chase(int first, int last, int period, int width=1, int layer=1, int ticks=0);
+        int Meter(int ring, int hold, int layer=0);
+        void SetLevel(int id, int level);
+        void Stop(int id);
+        void StopAll();
+        int Running();
+
+        void Tick();
+        void Update();
+
+    private:
+        int Start(xt_led_animation_t *animation);
+        int Lit(xt_led_animation_t *animation, int index, int count);
+        void Draw(xt_led_animation_t *animation);
+        void Compose();
+
+        XTouch *mBoard;
+        unsigned int mTicks;
+        unsigned int mOrder;
+
+        xt_button_state_t mBaseButtons[XT_LEDS_BUTTONS];
+        unsigned int mBaseRings[8];
+        xt_button_state_t mButtons[XT_LEDS_BUTTONS];     // The frame being composed
+        unsigned int mRings[8];
+        xt_button_state_t mSentButtons[XT_LEDS_BUTTONS];
+        unsigned int mSentRings[8];
+
+        xt_led_animation_t mAnimations[XT_LEDS_ANIMATIONS];
+};
+
+#endif
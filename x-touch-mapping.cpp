@@ -0,0 +1,396 @@
+/* ----------------------------------------------------------------
+                   x-touch-xctl library - control mapping.
+   Binds the surface controls (buttons, dials and faders) to
+   application parameter IDs using a plain text mapping file,
+   so that surface behaviour can be changed without recompiling.
+   ---------------------------------------------------------------- */
+
+/*
+MIT License
+
+Copyright (c) 2020 Martin Whitaker
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#include "x-touch-mapping.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Reads a whole decimal number from text, stopping at stop (or the end). Returns 0 if
+// there isn't one or anything else follows it. *next is left after the stop character
+static int ParseNumber(const char *text, char stop, int *value, const char **next) {
+    char *end;
+    long v;
+    v=strtol(text,&end,10);
+    if ((end==text)||((*end!=0)&&(*end!=stop))||(v<-1000000)||(v>1000000)) return 0;
+    *value=(int)v;
+    if (next) *next=(*end)?end+1:end;
+    return 1;
+}
+
+// Public interfaces
+XTouchMapping::XTouchMapping() {
+    xt_map_table_t *table;
+    table=new xt_map_table_t;
+    memset(table,0,sizeof(xt_map_table_t));
+    table->BankCount=1;
+    table->BankSize=8;
+    mTable.store(table);
+    mRetired=NULL;
+    mBank=0;
+    mChannelLimit=0;
+    mFixedBankSize=0;
+    mParamCount=0;
+    mParamCallbackHandler=NULL;
+    mBankCallbackHandler=NULL;
+}
+
+XTouchMapping::~XTouchMapping() {
+    delete mTable.load();
+    delete mRetired;
+}
+
+// Gives a name to a parameter ID so it can be used in mapping files
+// Must be called before Load() for the name to be recognised
+// Returns 1 on success, 0 if the name is too long or the table is full
+int XTouchMapping::DefineParam(const char *name, int id) {
+    if ((mParamCount>=XT_MAP_MAX_PARAMS)||(strlen(name)>=XT_MAP_NAME_LEN)) return 0;
+    strcpy(mParamNames[mParamCount],name);
+    mParamIds[mParamCount]=id;
+    mParamCount++;
+    return 1;
+}
+
+// Rejects mappings that would address channels beyond this limit (0 = no limit)
+void XTouchMapping::SetChannelLimit(int channels) {
+    mChannelLimit=channels;
+}
+
+// Rejects mappings whose banks aren't this many channels (0 = any size)
+void XTouchMapping::SetFixedBankSize(int size) {
+    mFixedBankSize=size;
+}
+
+// Compiles the mapping file and, if it is valid, makes it the active mapping
+// Can be called again at any time to reload - the previous mapping stays
+// active until the new one has compiled without errors
+// Returns 1 on success, 0 on failure
+int XTouchMapping::Load(const char *filename) {
+    FILE *f;
+    char *text;
+    long len;
+    int result;
+
+    f=fopen(filename,"r");
+    if (!f) {
+        perror(filename);
+        return 0;
+    }
+    fseek(f,0,SEEK_END);
+    len=ftell(f);
+    fseek(f,0,SEEK_SET);
+    if (len<0) {
+        fclose(f);
+        return 0;
+    }
+    text=(char *)malloc(len+1);
+    if (!text) {
+        fclose(f);
+        return 0;
+    }
+    len=fread(text,1,len,f);
+    text[len]=0;
+    fclose(f);
+    result=LoadString(text);
+    free(text);
+    return result;
+}
+
+// As Load() but takes the mapping text directly
+int XTouchMapping::LoadString(const char *text) {
+    xt_map_table_t *table;
+    table=new xt_map_table_t;
+    if (!Compile(text,table)) {
+        delete table;
+        return 0;
+    }
+    Install(table);
+    return 1;
+}
+
+// Pass button events from the XTouch button callback through here
+// Returns 1 if the button is mapped, 0 if it isn't
+int XTouchMapping::HandleButton(unsigned char button, int value) {
+    if (button>127) return 0;
+    return Dispatch(&mTable.load(std::memory_order_acquire)->Buttons[button],value);
+}
+
+// Pass dial events from the XTouch dial callback through here
+// Returns 1 if the dial is mapped, 0 if it isn't
+int XTouchMapping::HandleDial(unsigned char dial, int value) {
+    if (dial>127) return 0;
+    return Dispatch(&mTable.load(std::memory_order_acquire)->Dials[dial],value);
+}
+
+// Pass fader level events from the XTouch fader callback through here
+// Returns 1 if the fader is mapped, 0 if it isn't
+int XTouchMapping::HandleFader(unsigned char fader, int value) {
+    if (fader>15) return 0;
+    return Dispatch(&mTable.load(std::memory_order_acquire)->Faders[fader],value);
+}
+
+// Returns how a button is mapped, e.g. to decide whether to light it whilst held
+xt_map_mode_t XTouchMapping::ButtonMode(unsigned char button) {
+    if (button>127) return XT_MAP_NONE;
+    return (xt_map_mode_t)mTable.load(std::memory_order_acquire)->Buttons[button].Mode;
+}
+
+int XTouchMapping::Bank() {
+    return mBank;
+}
+
+int XTouchMapping::BankCount() {
+    return mTable.load(std::memory_order_acquire)->BankCount;
+}
+
+int XTouchMapping::BankSize() {
+    return mTable.load(std::memory_order_acquire)->BankSize;
+}
+
+// Selects a bank directly (0 to BankCount()-1). The bank callback is called if it changes
+void XTouchMapping::SetBank(int bank) {
+    if ((bank<0)||(bank>=BankCount())||(bank==mBank)) return;
+    mBank=bank;
+    if (mBankCallbackHandler) mBankCallbackHandler(mBankCallbackData,0,mBank);
+}
+
+// The handler registered here will be called whenever a mapped control changes a parameter
+// Toggle buttons pass 1 when pressed, momentary buttons pass 1/0 for pressed/released,
+// dials pass the number of clicks turned and faders pass the new level
+void XTouchMapping::RegisterParamCallback(param_handler Handler, void *data) {
+    mParamCallbackHandler=Handler;
+    mParamCallbackData=data;
+}
+
+// The handler registered here will be called whenever the bank changes (value = new bank)
+void XTouchMapping::RegisterBankCallback(callback Handler, void *data) {
+    mBankCallbackHandler=Handler;
+    mBankCallbackData=data;
+}
+
+// ----------------------------------------------------------------------------------------------
+// Private functions
+// ----------------------------------------------------------------------------------------------
+
+int XTouchMapping::Dispatch(const xt_map_entry_t *entry, int value) {
+    int channel, bank;
+    switch (entry->Mode) {
+        case XT_MAP_NONE:
+                return 0;
+        case XT_MAP_TOGGLE:
+                if (!value) return 1;
+                break;
+        case XT_MAP_BANK:
+                bank=mBank+value;
+                if (bank<0) bank=0;
+                if (bank>=BankCount()) bank=BankCount()-1;
+                SetBank(bank);
+                return 1;
+        case XT_MAP_BANKDOWN:
+                if (value) SetBank(mBank-1);
+                return 1;
+        case XT_MAP_BANKUP:
+                if (value) SetBank(mBank+1);
+                return 1;
+        default: break;
+    }
+    channel=entry->Offset;
+    if (entry->Strip) channel+=mBank*mTable.load(std::memory_order_relaxed)->BankSize;
+    if (mParamCallbackHandler) mParamCallbackHandler(mParamCallbackData,entry->Param,channel,value);
+    return 1;
+}
+
+// The new table is swapped in with a single pointer store, so an event never sees a half
+// built mapping. The old table is kept until the next reload in case another thread is
+// still dispatching through it
+void XTouchMapping::Install(xt_map_table_t *table) {
+    xt_map_table_t *old;
+    old=mTable.exchange(table,std::memory_order_acq_rel);
+    delete mRetired;
+    mRetired=old;
+    if (mBank>=table->BankCount) {
+        mBank=table->BankCount-1;
+        if (mBankCallbackHandler) mBankCallbackHandler(mBankCallbackData,0,mBank);
+    }
+}
+
+int XTouchMapping::Compile(const char *text, xt_map_table_t *table) {
+    char line[256];
+    const char *p;
+    const char *eol;
+    int lineno=0;
+    int len;
+
+    memset(table,0,sizeof(xt_map_table_t));
+    table->BankCount=1;
+    table->BankSize=8;
+    p=text;
+    while (*p) {
+        lineno++;
+        eol=strchr(p,'\n');
+        if (!eol) eol=p+strlen(p);
+        len=eol-p;
+        if (len>=(int)sizeof(line)) {
+            printf("Mapping line %d: line too long\n",lineno);
+            return 0;
+        }
+        memcpy(line,p,len);
+        line[len]=0;
+        if (!CompileLine(line,lineno,table)) return 0;
+        p=(*eol)?eol+1:eol;
+    }
+    if ((mFixedBankSize>0)&&(table->BankSize!=mFixedBankSize)) {
+        printf("Mapping: banks must be %d channels\n",mFixedBankSize);
+        return 0;
+    }
+    if ((mChannelLimit>0)&&(table->BankCount*table->BankSize>mChannelLimit)) {
+        printf("Mapping: %d banks of %d exceeds the %d available channels\n",table->BankCount,table->BankSize,mChannelLimit);
+        return 0;
+    }
+    return 1;
+}
+
+int XTouchMapping::CompileLine(char *line, int lineno, xt_map_table_t *table) {
+    char *words[8];
+    char *save;
+    char *w;
+    int count=0;
+    int first, last, limit, param, haveparam, strip, i;
+    int banks, size;
+    const char *next;
+    xt_map_mode_t mode;
+    xt_map_entry_t *entries;
+
+    w=strchr(line,'#');
+    if (w) *w=0;
+    for(w=strtok_r(line," \t\r",&save);w;w=strtok_r(NULL," \t\r",&save)) {
+        if (count==8) {
+            printf("Mapping line %d: too many fields\n",lineno);
+            return 0;
+        }
+        words[count++]=w;
+    }
+    if (count==0) return 1;
+
+    if (strcmp(words[0],"banks")==0) {
+        if ((count!=3)||(!ParseNumber(words[1],0,&banks,NULL))||(!ParseNumber(words[2],0,&size,NULL))||(banks<1)||(size<1)) {
+            printf("Mapping line %d: expected 'banks <count> <size>'\n",lineno);
+            return 0;
+        }
+        table->BankCount=banks;
+        table->BankSize=size;
+        return 1;
+    }
+
+    if (strcmp(words[0],"button")==0) {
+        entries=table->Buttons;
+        limit=127;
+    } else if (strcmp(words[0],"dial")==0) {
+        entries=table->Dials;
+        limit=127;
+    } else if (strcmp(words[0],"fader")==0) {
+        entries=table->Faders;
+        limit=15;
+    } else {
+        printf("Mapping line %d: unknown control '%s'\n",lineno,words[0]);
+        return 0;
+    }
+    if (count<3) {
+        printf("Mapping line %d: expected '%s <id> <mode> [<param>] [strip]'\n",lineno,words[0]);
+        return 0;
+    }
+
+    last=-1;
+    if (ParseNumber(words[1],'-',&first,&next)) {
+        last=first;
+        if ((*next!=0)&&(!ParseNumber(next,0,&last,NULL))) last=-1;
+        if ((next[-1]=='-')&&(*next==0)) last=-1;      // "5-"
+    }
+    if ((last<0)||(first<0)||(last<first)||(last>limit)) {
+        printf("Mapping line %d: bad %s range '%s'\n",lineno,words[0],words[1]);
+        return 0;
+    }
+
+    if (strcmp(words[2],"toggle")==0) mode=XT_MAP_TOGGLE;
+    else if (strcmp(words[2],"momentary")==0) mode=XT_MAP_MOMENTARY;
+    else if (strcmp(words[2],"absolute")==0) mode=XT_MAP_ABSOLUTE;
+    else if (strcmp(words[2],"relative")==0) mode=XT_MAP_RELATIVE;
+    else if (strcmp(words[2],"bank")==0) mode=XT_MAP_BANK;
+    else if (strcmp(words[2],"bankdown")==0) mode=XT_MAP_BANKDOWN;
+    else if (strcmp(words[2],"bankup")==0) mode=XT_MAP_BANKUP;
+    else mode=XT_MAP_NONE;
+    if ((mode==XT_MAP_NONE)||
+        ((entries==table->Buttons)&&(mode!=XT_MAP_TOGGLE)&&(mode!=XT_MAP_MOMENTARY)&&(mode!=XT_MAP_BANKDOWN)&&(mode!=XT_MAP_BANKUP))||
+        ((entries==table->Dials)&&(mode!=XT_MAP_RELATIVE)&&(mode!=XT_MAP_BANK))||
+        ((entries==table->Faders)&&(mode!=XT_MAP_ABSOLUTE))) {
+        printf("Mapping line %d: mode '%s' not valid for a %s\n",lineno,words[2],words[0]);
+        return 0;
+    }
+
+    param=0;
+    haveparam=0;
+    strip=0;
+    for(i=3;i<count;i++) {
+        if (strcmp(words[i],"strip")==0) {
+            strip=1;
+        } else if (LookupParam(words[i],&param)) {
+            haveparam=1;
+        } else {
+            printf("Mapping line %d: unknown parameter '%s'\n",lineno,words[i]);
+            return 0;
+        }
+    }
+    if ((mode!=XT_MAP_BANK)&&(mode!=XT_MAP_BANKDOWN)&&(mode!=XT_MAP_BANKUP)&&(!haveparam)) {
+        printf("Mapping line %d: no parameter given\n",lineno);
+        return 0;
+    }
+
+    for(i=first;i<=last;i++) {
+        entries[i].Mode=mode;
+        entries[i].Strip=strip;
+        entries[i].Offset=i-first;
+        entries[i].Param=param;
+    }
+    return 1;
+}
+
+int XTouchMapping::LookupParam(const char *name, int *id) {
+    int i;
+    char *end;
+    for(i=0;i<mParamCount;i++) {
+        if (strcmp(mParamNames[i],name)==0) {
+            *id=mParamIds[i];
+            return 1;
+        }
+    }
+    *id=strtol(name,&end,10);
+    return (*end==0);
+}
@@ -0,0 +1,128 @@
+/* ----------------------------------------------------------------
+                   x-touch-xctl library - control mapping.
+   Binds the surface controls (buttons, dials and faders) to
+   application parameter IDs using a plain text mapping file,
+   so that surface behaviour can be changed without recompiling.
+   ---------------------------------------------------------------- */
+
+/*
+MIT License
+
+Copyright (c) 2020 Martin Whitaker
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+/* Mapping file format - one binding per line, '#' starts a comment:
+
+     banks <count> <size>
+     button <first>[-<last>] toggle|momentary|bankdown|bankup [<param>] [strip]
+     dial <first>[-<last>] relative|bank [<param>] [strip]
+     fader <first>[-<last>] absolute [<param>] [strip]
+
+   <param> is either a number or a name given to DefineParam().
+   The channel passed to the parameter handler is the control's offset
+   within the range (first=0). With 'strip' the current bank is added,
+   i.e. channel = bank * size + offset.
+
+   Example:
+     banks 8 8
+     button 16-23 toggle mute strip
+     button 46 bankdown
+     button 47 bankup
+     fader 0-7 absolute level strip
+*/
+
+#ifndef X_TOUCH_MAPPING_H
+#define X_TOUCH_MAPPING_H
+
+#include <atomic>
+#include "x-touch.h"
+
+typedef void (*param_handler)(void *, int, int, int); // User pointer, Parameter ID, Channel, Value
+
+enum xt_map_mode_t { XT_MAP_NONE, XT_MAP_TOGGLE, XT_MAP_MOMENTARY, XT_MAP_ABSOLUTE, XT_MAP_RELATIVE, XT_MAP_BANK, XT_MAP_BANKDOWN, XT_MAP_BANKUP };
+
+#define XT_MAP_MAX_PARAMS 64
+#define XT_MAP_NAME_LEN 16
+
+typedef struct {
+    unsigned char Mode;     // xt_map_mode_t
+    unsigned char Strip;    // Non-zero if the channel follows the current bank
+    short Offset;           // Channel offset within the bound range
+    int Param;
+} xt_map_entry_t;
+
+// A compiled mapping. Indexed directly by the control ID from the X-Touch
+typedef struct {
+    xt_map_entry_t Buttons[128];
+    xt_map_entry_t Dials[128];
+    xt_map_entry_t Faders[16];
+    int BankCount;
+    int BankSize;
+} xt_map_table_t;
+
+class XTouchMapping {
+    public:
+        XTouchMapping();
+        ~XTouchMapping();
+
+        int DefineParam(const char *name, int id);
+        void SetChannelLimit(int channels);
+        void SetFixedBankSize(int size);
+        int Load(const char *filename);
+        int LoadString(const char *text);
+
+        int HandleButton(unsigned char button, int value);
+        int HandleDial(unsigned char dial, int value);
+        int HandleFader(unsigned char fader, int value);
+        xt_map_mode_t ButtonMode(unsigned char button);
+
+        int Bank();
+        int BankCount();
+        int BankSize();
+        void SetBank(int bank);
+
+        void RegisterParamCallback(param_handler Handler, void *data);
+        void RegisterBankCallback(callback Handler, void *data);
+
+    private:
+        int Compile(const char *text, xt_map_table_t *table);
+        int CompileLine(char *line, int lineno, xt_map_table_t *table);
+        int LookupParam(const char *name, int *id);
+        void Install(xt_map_table_t *table);
+        int Dispatch(const xt_map_entry_t *entry, int value);
+
+        std::atomic<xt_map_table_t*> mTable;
+        xt_map_table_t *mRetired;
+        int mBank;
+        int mChannelLimit;
+        int mFixedBankSize;
+
+        char mParamNames[XT_MAP_MAX_PARAMS][XT_MAP_NAME_LEN];
+        int mParamIds[XT_MAP_MAX_PARAMS];
+        int mParamCount;
+
+        param_handler mParamCallbackHandler;
+        callback mBankCallbackHandler;
+        void *mParamCallbackData;
+        void *mBankCallbackData;
+};
+
+#endif
@@ -0,0 +1,385 @@
+/* ----------------------------------------------------------------
+                   x-touch-xctl library - audio metering.
+   Works out the peak and RMS level of each channel of an audio
+   buffer and converts them to the 0-9 scale of the X-Touch's
+   meters. Uses AVX2 or SSE where the CPU has them.
+   ---------------------------------------------------------------- */
+
+
+/*
+MIT License
+
+Copyright (c) 2020 Martin Whitaker
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#include "x-touch-meter.h"
+#include <math.h>
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define XT_METER_X86
+#endif
+
+// The level in dBFS each LED on the meter comes on at. 9 is the clip light
+static const float MeterThresholds[9] = { -60, -50, -40, -30, -24, -18, -12, -6, 0 };
+
+// Interleaved buffers are worked through in chunks of about this many samples that
+// stay in the L1 cache, so that each vector lane's accumulators only need one pass
+#define CHUNK_SAMPLES 4096
+
+static int Lcm(int a, int b) {
+    int x=a;
+    int y=b;
+    int t;
+    while (y) {
+        t=x%y;
+        x=y;
+        y=t;
+    }
+    return a/x*b;
+}
+
+// ----------------------------------------------------------------------------------------------
+// Kernels. Each one adds the peak and sum of squares of every channel into peak[] and sum[]
+// ----------------------------------------------------------------------------------------------
+
+static void InterleavedScalar(const float *samples, int frames, int channels, float *peak, double *sum) {
+    int i;
+    int ch;
+    float v;
+    for(i=0;i<frames;i++) {
+        for(ch=0;ch<channels;ch++) {
+            v=fabsf(samples[ch]);
+            if (v>peak[ch]) peak[ch]=v;
+            sum[ch]+=v*v;
+        }
+        samples+=channels;
+    }
+}
+
+static void PlanarScalar(const float *samples, int frames, float *peak, double *sum) {
+    int i;
+    float v;
+    float p=*peak;
+    float s=0;
+    for(i=0;i<frames;i++) {
+        v=fabsf(samples[i]);
+        if (v>p) p=v;
+        s+=v*v;
+    }
+    *peak=p;
+    *sum+=s;
+}
+
+#ifdef XT_METER_X86
+
+// With the samples laid out in blocks of lcm(channels,lanes), each lane of a vector
+// loaded from the same offset in every block always holds the same channel. So
+// each offset is worked through every block in the chunk with its own accumulators,
+// which are then added into the channel each lane holds
+__attribute__((target("sse2")))
+static void InterleavedSse(const float *samples, int frames, int channels, float *peak, double *sum) {
+    int block=Lcm(channels,4);
+    int blockframes=block/channels;
+    int blocks=frames/blockframes;
+    int chunk=(CHUNK_SAMPLES/block>0)?CHUNK_SAMPLES/block:1;
+    const __m128 absmask=_mm_castsi128_ps(_mm_set1_epi32(0x7fffffff));
+    __m128 p0,p1,s0,s1,v0,v1;
+    float lanepeak[4] __attribute__((aligned(16)));
+    float lanesum[4] __attribute__((aligned(16)));
+    const float *base;
+    int b,n,k,j,i,ch;
+
+    for(b=0;b<blocks;b+=chunk) {
+        n=(blocks-b<chunk)?blocks-b:chunk;
+        base=samples+(long)b*block;
+        for(k=0;k<block;k+=4) {
+            p0=p1=s0=s1=_mm_setzero_ps();
+            for(j=0;j+1<n;j+=2) {
+                v0=_mm_and_ps(_mm_loadu_ps(base+(long)j*block+k),absmask);
+                v1=_mm_and_ps(_mm_loadu_ps(base+(long)(j+1)*block+k),absmask);
+                p0=_mm_max_ps(p0,v0);
+                p1=_mm_max_ps(p1,v1);
+                s0=_mm_add_ps(s0,_mm_mul_ps(v0,v0));
+                s1=_mm_add_ps(s1,_mm_mul_ps(v1,v1));
+            }
+            if (j<n) {
+                v0=_mm_and_ps(_mm_loadu_ps(base+(long)j*block+k),absmask);
+                p0=_mm_max_ps(p0,v0);
+                s0=_mm_add_ps(s0,_mm_mul_ps(v0,v0));
+            }
+            _mm_store_ps(lanepeak,_mm_max_ps(p0,p1));
+            _mm_store_ps(lanesum,_mm_add_ps(s0,s1));
+            for(i=0;i<4;i++) {
+                ch=(k+i)%channels;
+                if (lanepeak[i]>peak[ch]) peak[ch]=lanepeak[i];
+                sum[ch]+=lanesum[i];
+            }
+        }
+    }
+    InterleavedScalar(samples+(long)blocks*block,frames-blocks*blockframes,channels,peak,sum);
+}
+
+__attribute__((target("sse2")))
+static void PlanarSse(const float *samples, int frames, float *peak, double *sum) {
+    const __m128 absmask=_mm_castsi128_ps(_mm_set1_epi32(0x7fffffff));
+    __m128 p0,p1,s0,s1,v0,v1;
+    float lanepeak[4] __attribute__((aligned(16)));
+    float lanesum[4] __attribute__((aligned(16)));
+    int i;
+    int l;
+
+    p0=p1=s0=s1=_mm_setzero_ps();
+    for(i=0;i+8<=frames;i+=8) {
+        v0=_mm_and_ps(_mm_loadu_ps(samples+i),absmask);
+        v1=_mm_and_ps(_mm_loadu_ps(samples+i+4),absmask);
+        p0=_mm_max_ps(p0,v0);
+        p1=_mm_max_ps(p1,v1);
+        s0=_mm_add_ps(s0,_mm_mul_ps(v0,v0));
+        s1=_mm_add_ps(s1,_mm_mul_ps(v1,v1));
+    }
+    _mm_store_ps(lanepeak,_mm_max_ps(p0,p1));
+    _mm_store_ps(lanesum,_mm_add_ps(s0,s1));
+    for(l=0;l<4;l++) {
+        if (lanepeak[l]>*peak) *peak=lanepeak[l];
+        *sum+=lanesum[l];
+    }
+    PlanarScalar(samples+i,frames-i,peak,sum);
+}
+
+__attribute__((target("avx2")))
+static void InterleavedAvx2(const float *samples, int frames, int channels, float *peak, double *sum) {
+    int block=Lcm(channels,8);
+    int blockframes=block/channels;
+    int blocks=frames/blockframes;
+    int chunk=(CHUNK_SAMPLES/block>0)?CHUNK_SAMPLES/block:1;
+    const __m256 absmask=_mm256_castsi256_ps(_mm256_set1_epi32(0x7fffffff));
+    __m256 p0,p1,s0,s1,v0,v1;
+    float lanepeak[8] __attribute__((aligned(32)));
+    float lanesum[8] __attribute__((aligned(32)));
+    const float *base;
+    int b,n,k,j,i,ch;
+
+    for(b=0;b<blocks;b+=chunk) {
+        n=(blocks-b<chunk)?blocks-b:chunk;
+        base=samples+(long)b*block;
+        for(k=0;k<block;k+=8) {
+            p0=p1=s0=s1=_mm256_setzero_ps();
+            for(j=0;j+1<n;j+=2) {
+                v0=_mm256_and_ps(_mm256_loadu_ps(base+(long)j*block+k),absmask);
+                v1=_mm256_and_ps(_mm256_loadu_ps(base+(long)(j+1)*block+k),absmask);
+                p0=_mm256_max_ps(p0,v0);
+                p1=_mm256_max_ps(p1,v1);
+                s0=_mm256_add_ps(s0,_mm256_mul_ps(v0,v0));
+                s1=_mm256_add_ps(s1,_mm256_mul_ps(v1,v1));
+            }
+            if (j<n) {
+                v0=_mm256_and_ps(_mm256_loadu_ps(base+(long)j*block+k),absmask);
+                p0=_mm256_max_ps(p0,v0);
+                s0=_mm256_add_ps(s0,_mm256_mul_ps(v0,v0));
+            }
+            _mm256_store_ps(lanepeak,_mm256_max_ps(p0,p1));
+            _mm256_store_ps(lanesum,_mm256_add_ps(s0,s1));
+            for(i=0;i<8;i++) {
+                ch=(k+i)%channels;
+                if (lanepeak[i]>peak[ch]) peak[ch]=lanepeak[i];
+                sum[ch]+=lanesum[i];
+            }
+        }
+    }
+    InterleavedScalar(samples+(long)blocks*block,frames-blocks*blockframes,channels,peak,sum);
+}
+
+__attribute__((target("avx2")))
+static void PlanarAvx2(const float *samples, int frames, float *peak, double *sum) {
+    const __m256 absmask=_mm256_castsi256_ps(_mm256_set1_epi32(0x7fffffff));
+    __m256 p0,p1,s0,s1,v0,v1;
+    float lanepeak[8] __attribute__((aligned(32)));
+    float lanesum[8] __attribute__((aligned(32)));
+    int i;
+    int l;
+
+    p0=p1=s0=s1=_mm256_setzero_ps();
+    for(i=0;i+16<=frames;i+=16) {
+        v0=_mm256_and_ps(_mm256_loadu_ps(samples+i),absmask);
+        v1=_mm256_and_ps(_mm256_loadu_ps(samples+i+8),absmask);
+        p0=_mm256_max_ps(p0,v0);
+        p1=_mm256_max_ps(p1,v1);
+        s0=_mm256_add_ps(s0,_mm256_mul_ps(v0,v0));
+        s1=_mm256_add_ps(s1,_mm256_mul_ps(v1,v1));
+    }
+    _mm256_store_ps(lanepeak,_mm256_max_ps(p0,p1));
+    _mm256_store_ps(lanesum,_mm256_add_ps(s0,s1));
+    for(l=0;l<8;l++) {
+        if (lanepeak[l]>*peak) *peak=lanepeak[l];
+        *sum+=lanesum[l];
+    }
+    PlanarScalar(samples+i,frames-i,peak,sum);
+}
+
+#endif
+
+// ----------------------------------------------------------------------------------------------
+// Public interfaces
+// ----------------------------------------------------------------------------------------------
+
+// channels = 1 to XT_METER_MAX_CHANNELS
+XTouchMeter::XTouchMeter(int channels) {
+    if (channels<1) channels=1;
+    if (channels>XT_METER_MAX_CHANNELS) channels=XT_METER_MAX_CHANNELS;
+    mChannels=channels;
+    SetKernel(XT_METER_AUTO);
+    Reset();
+}
+
+XTouchMeter::~XTouchMeter() {
+
+}
+
+// Chooses which kernel to use - normally left as the fastest one the CPU has
+// Returns the kernel actually used, as it falls back to one the CPU does have
+xt_meter_kernel_t XTouchMeter::SetKernel(xt_meter_kernel_t kernel) {
+    mKernel=XT_METER_SCALAR;
+#ifdef XT_METER_X86
+    __builtin_cpu_init();
+    if ((kernel==XT_METER_AUTO)||(kernel==XT_METER_AVX2)) {
+        if (__builtin_cpu_supports("avx2")) {
+            mKernel=XT_METER_AVX2;
+            return mKernel;
+        }
+        kernel=XT_METER_SSE;
+    }
+    if ((kernel==XT_METER_SSE)&&(__builtin_cpu_supports("sse2"))) {
+        mKernel=XT_METER_SSE;
+    }
+#endif
+    return mKernel;
+}
+
+xt_meter_kernel_t XTouchMeter::Kernel() {
+    return mKernel;
+}
+
+const char *XTouchMeter::KernelName(xt_meter_kernel_t kernel) {
+    switch (kernel) {
+        case XT_METER_AUTO: return "auto";
+        case XT_METER_SCALAR: return "scalar";
+        case XT_METER_SSE: return "sse";
+        case XT_METER_AVX2: return "avx2";
+    }
+    return "?";
+}
+
+// samples holds frames*channels interleaved samples
+void XTouchMeter::Analyse(const float *samples, int frames) {
+    if (frames<=0) return;
+    switch (mKernel) {
+#ifdef XT_METER_X86
+        case XT_METER_AVX2: InterleavedAvx2(samples,frames,mChannels,mPeak,mSum); break;
+        case XT_METER_SSE: InterleavedSse(samples,frames,mChannels,mPeak,mSum); break;
+#endif
+        default: InterleavedScalar(samples,frames,mChannels,mPeak,mSum); break;
+    }
+    mFrames+=frames;
+}
+
+// samples holds a pointer to frames samples for each channel
+void XTouchMeter::AnalysePlanar(const float * const *samples, int frames) {
+    int ch;
+    int start;
+    int n;
+    if (frames<=0) return;
+    for(ch=0;ch<mChannels;ch++) {
+        // The kernels sum in floats, so long buffers are split up to keep the precision
+        for(start=0;start<frames;start+=CHUNK_SAMPLES) {
+            n=(frames-start<CHUNK_SAMPLES)?frames-start:CHUNK_SAMPLES;
+            switch (mKernel) {
+#ifdef XT_METER_X86
+                case XT_METER_AVX2: PlanarAvx2(samples[ch]+start,n,&mPeak[ch],&mSum[ch]); break;
+                case XT_METER_SSE: PlanarSse(samples[ch]+start,n,&mPeak[ch],&mSum[ch]); break;
+#endif
+                default: PlanarScalar(samples[ch]+start,n,&mPeak[ch],&mSum[ch]); break;
+            }
+        }
+    }
+    mFrames+=frames;
+}
+
+// Starts a new measurement period
+void XTouchMeter::Reset() {
+    int ch;
+    for(ch=0;ch<XT_METER_MAX_CHANNELS;ch++) {
+        mPeak[ch]=0;
+        mSum[ch]=0;
+    }
+    mFrames=0;
+}
+
+int XTouchMeter::Channels() {
+    return mChannels;
+}
+
+// Highest absolute sample value since Reset(), 1.0 being full scale
+float XTouchMeter::Peak(int channel) {
+    if ((channel<0)||(channel>=mChannels)) return 0;
+    return mPeak[channel];
+}
+
+// RMS level since Reset(), 1.0 being full scale
+float XTouchMeter::Rms(int channel) {
+    if ((channel<0)||(channel>=mChannels)||(mFrames==0)) return 0;
+    return sqrt(mSum[channel]/mFrames);
+}
+
+// Returns the level on the X-Touch's 0-9 scale, from the peak or the RMS level
+int XTouchMeter::Level(int channel, int rms) {
+    return DbToLevel(ToDb(rms?Rms(channel):Peak(channel)));
+}
+
+// Shows channels first to first+7 on the 8 channel strip meters
+// Channels that don't exist show nothing
+void XTouchMeter::Show(XTouch *board, int first, int rms) {
+    int i;
+    board->BeginBatch();
+    for(i=0;i<8;i++) {
+        if ((first+i>=0)&&(first+i<mChannels)) {
+            board->SetMeterLevel(i,Level(first+i,rms));
+        } else {
+            board->SetMeterLevel(i,0);
+        }
+    }
+    board->EndBatch();
+}
+
+// Converts a linear level to dBFS. Silence gives -200dB rather than -infinity
+float XTouchMeter::ToDb(float level) {
+    if (level<1e-10f) return -200;
+    return 20*log10f(level);
+}
+
+// Converts dBFS to the X-Touch's 0-9 meter scale
+// Each LED comes on at -60, -50, -40, -30, -24, -18, -12 and -6dB, and clip at 0dB
+int XTouchMeter::DbToLevel(float db) {
+    int level=0;
+    while ((level<9)&&(db>=MeterThresholds[level])) level++;
+    return level;
+}
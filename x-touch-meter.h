@@ -0,0 +1,85 @@
+/* ----------------------------------------------------------------
+                   x-touch-xctl library - audio metering.
+   Works out the peak and RMS level of each channel of an audio
+   buffer and converts them to the 0-9 scale of the X-Touch's
+   meters. Uses AVX2 or SSE where the CPU has them.
+   ---------------------------------------------------------------- */
+
+/*
+MIT License
+
+Copyright (c) 2020 Martin Whitaker
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+/* Samples are floats with full scale at +/-1.0, either interleaved (one buffer
+   holding a frame of every channel after another) or planar (a buffer per channel).
+   Levels build up over however many buffers are analysed until Reset() is called,
+   so analyse each buffer as it arrives and show and reset the meters at the rate
+   they are sent to the X-Touch.
+
+   Usage:
+     XTouchMeter meter(8);
+     meter.Analyse(samples,frames);          // From the audio callback
+     ... every 100ms:
+     meter.Show(&board,0);                   // Channels 0-7 onto strips 1-8
+     meter.Reset();
+*/
+
+#ifndef X_TOUCH_METER_H
+#define X_TOUCH_METER_H
+
+#include "x-touch.h"
+
+#define XT_METER_MAX_CHANNELS 64
+
+enum xt_meter_kernel_t { XT_METER_AUTO, XT_METER_SCALAR, XT_METER_SSE, XT_METER_AVX2 };
+
+class XTouchMeter {
+    public:
+        XTouchMeter(int channels);
+        ~XTouchMeter();
+
+        xt_meter_kernel_t SetKernel(xt_meter_kernel_t kernel);
+        xt_meter_kernel_t Kernel();
+        static const char *KernelName(xt_meter_kernel_t kernel);
+
+        void Analyse(const float *samples, int frames);
+        void AnalysePlanar(const float * const *samples, int frames);
+        void Reset();
+
+        int Channels();
+        float Peak(int channel);
+        float Rms(int channel);
+        int Level(int channel, int rms=0);
+        void Show(XTouch *board, int first, int rms=0);
+
+        static float ToDb(float level);
+        static int DbToLevel(float db);
+
+    private:
+        int mChannels;
+        xt_meter_kernel_t mKernel;
+        long mFrames;
+        float mPeak[XT_METER_MAX_CHANNELS];
+        double mSum[XT_METER_MAX_CHANNELS];       // Sum of the squares of the samples
+};
+
+#endif
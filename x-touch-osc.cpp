@@ -0,0 +1,263 @@
+/* ----------------------------------------------------------------
+                   x-touch-xctl library - OSC encoding.
+   Reads and writes Open Sound Control messages and bundles so the
+   X-Touch can be driven by, and report to, other applications.
+   Like the XTouch class it doesn't do any networking itself.
+   ---------------------------------------------------------------- */
+
+/*
+MIT License
+
+Copyright (c) 2020 Martin Whitaker
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#include "x-touch-osc.h"
+#include <stdarg.h>
+#include <stdint.h>
+#include <string.h>
+
+#define OSC_MAX_DEPTH 8
+
+static uint32_t ReadBE32(const unsigned char *p) {
+    return ((uint32_t)p[0]<<24)|((uint32_t)p[1]<<16)|((uint32_t)p[2]<<8)|p[3];
+}
+
+static void WriteBE32(unsigned char *p, uint32_t v) {
+    p[0]=v>>24;
+    p[1]=v>>16;
+    p[2]=v>>8;
+    p[3]=v;
+}
+
+// Public interfaces
+XTouchOsc::XTouchOsc() {
+    mMessageCallbackHandler=NULL;
+    mBundleCallbackHandler=NULL;
+}
+
+XTouchOsc::~XTouchOsc() {
+
+}
+
+// The handler registered here will be called for every message, including those inside bundles
+void XTouchOsc::RegisterMessageCallback(osc_handler Handler, void *data) {
+    mMessageCallbackHandler=Handler;
+    mMessageCallbackData=data;
+}
+
+// The handler registered here will be called with value 1 at the start and 0 at the end of
+// each bundle (the object ID is the nesting depth), e.g. to wrap it in XTouch::BeginBatch()
+void XTouchOsc::RegisterBundleCallback(callback Handler, void *data) {
+    mBundleCallbackHandler=Handler;
+    mBundleCallbackData=data;
+}
+
+// Decodes a received UDP packet in place - nothing is copied
+// Returns the number of messages handled, or -1 if the packet is malformed
+// (messages before the fault will already have been handled)
+int XTouchOsc::HandlePacket(const unsigned char *buffer, unsigned int len) {
+    return HandleElement(buffer,len,0);
+}
+
+// Reads the next argument as an integer. Floats are truncated, T and F give 1 and 0
+// Returns 1 on success, 0 if there are no more arguments or it isn't a number
+int XTouchOsc::ReadInt(xt_osc_message_t *msg, int *value) {
+    uint32_t v;
+    switch (*msg->NextType) {
+        case 'i':
+        case 'f':
+                if (msg->NextArg+4>msg->End) return 0;
+                v=ReadBE32(msg->NextArg);
+                if (*msg->NextType=='f') {
+                    float f;
+                    memcpy(&f,&v,4);
+                    *value=(int)f;
+                } else {
+                    *value=(int32_t)v;
+                }
+                msg->NextArg+=4;
+                break;
+        case 'T': *value=1; break;
+        case 'F': *value=0; break;
+        default: return 0;
+    }
+    msg->NextType++;
+    return 1;
+}
+
+// Reads the next argument as a float. Integers are converted
+int XTouchOsc::ReadFloat(xt_osc_message_t *msg, float *value) {
+    uint32_t v;
+    if (((*msg->NextType!='i')&&(*msg->NextType!='f'))||(msg->NextArg+4>msg->End)) return 0;
+    v=ReadBE32(msg->NextArg);
+    if (*msg->NextType=='f') {
+        memcpy(value,&v,4);
+    } else {
+        *value=(float)(int32_t)v;
+    }
+    msg->NextArg+=4;
+    msg->NextType++;
+    return 1;
+}
+
+// Reads the next argument as a string. The pointer returned is into the packet buffer
+int XTouchOsc::ReadString(xt_osc_message_t *msg, const char **value) {
+    const char *s;
+    const unsigned char *p=msg->NextArg;
+    if ((*msg->NextType!='s')&&(*msg->NextType!='S')) return 0;
+    s=ReadPaddedString(&p,msg->End);
+    if (!s) return 0;
+    *value=s;
+    msg->NextArg=p;
+    msg->NextType++;
+    return 1;
+}
+
+// Builds a message into buffer. types is the type tag string without the ','
+// followed by one argument per tag: 'i' int, 'f' double, 's' const char *
+// Returns the length of the message, or 0 if it doesn't fit or a type isn't supported
+unsigned int XTouchOsc::Build(unsigned char *buffer, unsigned int size, const char *address, const char *types, ...) {
+    va_list args;
+    unsigned int pos=0;
+    unsigned int len;
+    const char *s;
+    const char *t;
+    float f;
+    uint32_t v;
+
+    len=strlen(address)+1;
+    if (pos+((len+3)&~3)>size) return 0;
+    memset(buffer+pos,0,(len+3)&~3);
+    memcpy(buffer+pos,address,len);
+    pos+=(len+3)&~3;
+
+    len=strlen(types)+2;
+    if (pos+((len+3)&~3)>size) return 0;
+    memset(buffer+pos,0,(len+3)&~3);
+    buffer[pos]=',';
+    memcpy(buffer+pos+1,types,len-1);
+    pos+=(len+3)&~3;
+
+    va_start(args,types);
+    for(t=types;*t;t++) {
+        switch (*t) {
+            case 'i':
+                    if (pos+4>size) break;
+                    WriteBE32(buffer+pos,(uint32_t)va_arg(args,int));
+                    pos+=4;
+                    continue;
+            case 'f':
+                    if (pos+4>size) break;
+                    f=(float)va_arg(args,double);
+                    memcpy(&v,&f,4);
+                    WriteBE32(buffer+pos,v);
+                    pos+=4;
+                    continue;
+            case 's':
+                    s=va_arg(args,const char *);
+                    len=strlen(s)+1;
+                    if (pos+((len+3)&~3)>size) break;
+                    memset(buffer+pos,0,(len+3)&~3);
+                    memcpy(buffer+pos,s,len);
+                    pos+=(len+3)&~3;
+                    continue;
+            default: break;
+        }
+        va_end(args);
+        return 0;
+    }
+    va_end(args);
+    return pos;
+}
+
+// ----------------------------------------------------------------------------------------------
+// Private functions
+// ----------------------------------------------------------------------------------------------
+
+int XTouchOsc::HandleElement(const unsigned char *buffer, unsigned int len, int depth) {
+    if ((len>=8)&&(memcmp(buffer,"#bundle",8)==0)) return HandleBundle(buffer,len,depth);
+    if ((len>0)&&(buffer[0]=='/')) return HandleMessage(buffer,len);
+    return -1;
+}
+
+// #bundle\0, 8 byte time tag, then each element as a 32 bit size followed by the element
+// Time tags are ignored - everything is applied as soon as it arrives
+int XTouchOsc::HandleBundle(const unsigned char *buffer, unsigned int len, int depth) {
+    unsigned int pos=16;
+    unsigned int size;
+    int count=0;
+    int n;
+
+    if ((len<16)||(depth>=OSC_MAX_DEPTH)) return -1;
+    if (mBundleCallbackHandler) mBundleCallbackHandler(mBundleCallbackData,depth,1);
+    while (pos+4<=len) {
+        size=ReadBE32(buffer+pos);
+        pos+=4;
+        if ((size>len-pos)||(size&3)) {
+            count=-1;
+            break;
+        }
+        n=HandleElement(buffer+pos,size,depth+1);
+        if (n<0) {
+            count=-1;
+            break;
+        }
+        count+=n;
+        pos+=size;
+    }
+    if (mBundleCallbackHandler) mBundleCallbackHandler(mBundleCallbackData,depth,0);
+    return count;
+}
+
+int XTouchOsc::HandleMessage(const unsigned char *buffer, unsigned int len) {
+    xt_osc_message_t msg;
+    const unsigned char *p=buffer;
+    const char *types;
+
+    msg.End=buffer+len;
+    msg.Address=ReadPaddedString(&p,msg.End);
+    if (!msg.Address) return -1;
+    // Very old OSC senders may leave out the type tags altogether
+    if (p<msg.End) {
+        types=ReadPaddedString(&p,msg.End);
+        if ((!types)||(types[0]!=',')) return -1;
+        msg.Types=types+1;
+    } else {
+        msg.Types="";
+    }
+    msg.NextType=msg.Types;
+    msg.NextArg=p;
+    if (mMessageCallbackHandler) mMessageCallbackHandler(mMessageCallbackData,&msg);
+    return 1;
+}
+
+// Strings are null terminated and padded with nulls to a multiple of 4 bytes
+const char *XTouchOsc::ReadPaddedString(const unsigned char **p, const unsigned char *end) {
+    const unsigned char *start=*p;
+    const unsigned char *nul;
+    unsigned int len;
+    nul=(const unsigned char *)memchr(start,0,end-start);
+    if (!nul) return NULL;
+    len=((nul-start)+4)&~3;
+    if (start+len>end) return NULL;
+    *p=start+len;
+    return (const char *)start;
+}
@@ -0,0 +1,75 @@
+/* ----------------------------------------------------------------
+                   x-touch-xctl library - OSC encoding.
+   Reads and writes Open Sound Control messages and bundles so the
+   X-Touch can be driven by, and report to, other applications.
+   Like the XTouch class it doesn't do any networking itself.
+   ---------------------------------------------------------------- */
+
+/*
+MIT License
+
+Copyright (c) 2020 Martin Whitaker
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#ifndef X_TOUCH_OSC_H
+#define X_TOUCH_OSC_H
+
+#include "x-touch.h"
+
+// A received message. Address, type tags and string arguments all point
+// straight into the packet buffer, which must stay valid whilst it is used
+typedef struct {
+    const char *Address;
+    const char *Types;              // Type tags, without the leading ','
+    const char *NextType;           // Read position - advanced by the Read functions
+    const unsigned char *NextArg;
+    const unsigned char *End;
+} xt_osc_message_t;
+
+typedef void (*osc_handler)(void *, xt_osc_message_t *); // User pointer, Message
+
+class XTouchOsc {
+    public:
+        XTouchOsc();
+        ~XTouchOsc();
+
+        int HandlePacket(const unsigned char *buffer, unsigned int len);
+        void RegisterMessageCallback(osc_handler Handler, void *data);
+        void RegisterBundleCallback(callback Handler, void *data);
+
+        static int ReadInt(xt_osc_message_t *msg, int *value);
+        static int ReadFloat(xt_osc_message_t *msg, float *value);
+        static int ReadString(xt_osc_message_t *msg, const char **value);
+        static unsigned int Build(unsigned char *buffer, unsigned int size, const char *address, const char *types, ...);
+
+    private:
+        int HandleElement(const unsigned char *buffer, unsigned int len, int depth);
+        int HandleBundle(const unsigned char *buffer, unsigned int len, int depth);
+        int HandleMessage(const unsigned char *buffer, unsigned int len);
+        static const char *ReadPaddedString(const unsigned char **p, const unsigned char *end);
+
+        osc_handler mMessageCallbackHandler;
+        callback mBundleCallbackHandler;
+        void *mMessageCallbackData;
+        void *mBundleCallbackData;
+};
+
+#endif
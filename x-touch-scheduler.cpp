@@ -0,0 +1,408 @@
+/* ----------------------------------------------------------------
+                   x-touch-xctl library - output scheduler.
+   Sits between the XTouch class and the transport, pacing packets
+   to a bytes/packets per second budget so the X-Touch isn't flooded,
+   and sending the most important updates first so that interactive
+   feedback isn't stuck behind a full refresh.
+   ---------------------------------------------------------------- */
+
+/*
+MIT License
+
+Copyright (c) 2020 Martin Whitaker
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#include "x-touch-scheduler.h"
+#include "x-touch-trace.h"
+#include <string.h>
+#include <time.h>
+
+#define KEY_SCRIBBLE 0x100
+#define KEY_FADER 0x200
+#define KEY_BUTTON 0x300
+#define KEY_METERS 0x400
+#define KEY_RING 0x500
+#define KEY_ALLRINGS 0x5ff
+#define KEY_SEGMENTS 0x600
+#define KEY_IDLE 0x700
+
+static int64_t NowUs() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC,&ts);
+    return (int64_t)ts.tv_sec*1000000+ts.tv_nsec/1000;
+}
+
+// Public interfaces
+// The packet sender passed here is the one that actually sends to the X-Touch,
+// e.g. XTouchTransport::SendHandler
+XTouchScheduler::XTouchScheduler(packet_sender PacketSendHandler, void *data) {
+    mPacketSendHandler=PacketSendHandler;
+    mPPacketData=data;
+    mTrace=NULL;
+    memset(mQueues,0,sizeof(mQueues));
+    memset(mSentSeq,0,sizeof(mSentSeq));
+    memset(mSentData,0,sizeof(mSentData));
+    mSeq=0;
+    mDropped=0;
+    mDropCallbackHandler=NULL;
+    mDropCallbackData=NULL;
+    SetRate(64000,800);
+}
+
+XTouchScheduler::~XTouchScheduler() {
+
+}
+
+// Pass this to the XTouch constructor, with the scheduler as the user pointer
+void XTouchScheduler::SendHandler(void *scheduler, unsigned char *buffer, unsigned int len) {
+    ((XTouchScheduler *)scheduler)->Send(buffer,len);
+}
+
+// Sets the budget for this X-Touch. Either can be 0 for no limit
+// Up to 50ms worth can be sent in one burst after a quiet period
+// The default of 64000 bytes and 800 packets a second is well within what the X-Touch copes with
+void XTouchScheduler::SetRate(unsigned int bytespersec, unsigned int packetspersec) {
+    mBytesPerSec=bytespersec;
+    mPacketsPerSec=packetspersec;
+    mByteBurst=bytespersec/20.0;
+    if (mByteBurst<XT_BATCH_SIZE) mByteBurst=XT_BATCH_SIZE;
+    mPacketBurst=packetspersec/20.0;
+    if (mPacketBurst<1) mPacketBurst=1;
+    mByteTokens=mByteBurst;
+    mPacketTokens=mPacketBurst;
+    mLastRefill=NowUs();
+}
+
+// Packets sent to the X-Touch are traced here, with how long they were queued (see x-touch-trace.h)
+void XTouchScheduler::SetTrace(XTouchTrace *trace) {
+    mTrace=trace;
+}
+
+// The handler registered here is called with the priority class and the total dropped so far
+// whenever a full queue throws packets away. Whatever they carried never reaches the X-Touch,
+// so the handler should arrange a full refresh, e.g. XTouch::RefreshHandler
+void XTouchScheduler::RegisterDropCallback(callback Handler, void *data) {
+    mDropCallbackHandler=Handler;
+    mDropCallbackData=data;
+}
+
+// Queues a packet and sends whatever the budget allows straight away
+void XTouchScheduler::Send(unsigned char *buffer, unsigned int len) {
+    xt_priority_t pri;
+    unsigned int key;
+    int64_t start;
+    if (len==0) return;
+    pri=Classify(buffer,len,&key);
+    if (!Enqueue(pri,buffer,len,key)) {
+        // Too big to ever queue
+        start=mTrace?XTouchTrace::Now():0;
+        Reconcile(buffer,len,++mSeq);
+        mPacketSendHandler(mPPacketData,buffer,len);
+        if (mTrace) mTrace->Sent(XT_TRACE_SCHEDULER,"Transmit",mTrace->Current(),start,start,buffer,len);
+        return;
+    }
+    Pump();
+}
+
+// Sends as many queued packets as the budget allows, highest priority first
+// Call this whenever NextDelay() has expired
+void XTouchScheduler::Pump() {
+    int pri;
+    xt_sched_entry_t *e;
+
+    Refill();
+    while (1) {
+        for(pri=0;pri<XT_PRI_CLASSES;pri++) {
+            if (mQueues[pri].Count) break;
+        }
+        if (pri==XT_PRI_CLASSES) return;
+        e=&mQueues[pri].Entries[mQueues[pri].Head];
+        // A packet bigger than the burst size goes once the bucket is full
+        if ((mBytesPerSec)&&(mByteTokens<e->Len)&&(mByteTokens<mByteBurst)) return;
+        if ((mPacketsPerSec)&&(mPacketTokens<1)) return;
+        mByteTokens-=e->Len;
+        mPacketTokens-=1;
+        Transmit((xt_priority_t)pri);
+    }
+}
+
+// Returns how many ms until Pump() can send the next queued packet,
+// 0 if it can send now, or -1 if nothing is queued (suitable as a poll() timeout)
+int XTouchScheduler::NextDelay() {
+    int pri;
+    double need;
+    double wait=0;
+    xt_sched_entry_t *e;
+
+    for(pri=0;pri<XT_PRI_CLASSES;pri++) {
+        if (mQueues[pri].Count) break;
+    }
+    if (pri==XT_PRI_CLASSES) return -1;
+    Refill();
+    e=&mQueues[pri].Entries[mQueues[pri].Head];
+    if (mBytesPerSec) {
+        need=((e->Len<mByteBurst)?e->Len:mByteBurst)-mByteTokens;
+        if (need>0) wait=need*1000.0/mBytesPerSec;
+    }
+    if ((mPacketsPerSec)&&(mPacketTokens<1)) {
+        need=(1-mPacketTokens)*1000.0/mPacketsPerSec;
+        if (need>wait) wait=need;
+    }
+    return (int)wait+((wait>(int)wait)?1:0);
+}
+
+// Returns the number of packets waiting to be sent
+int XTouchScheduler::Pending() {
+    int pri;
+    int count=0;
+    for(pri=0;pri<XT_PRI_CLASSES;pri++) {
+        count+=mQueues[pri].Count;
+    }
+    return count;
+}
+
+// Returns the number of packets thrown away because a queue was full
+unsigned int XTouchScheduler::Dropped() {
+    return mDropped;
+}
+
+// ----------------------------------------------------------------------------------------------
+// Private functions
+// ----------------------------------------------------------------------------------------------
+
+xt_priority_t XTouchScheduler::Classify(unsigned char *buffer, unsigned int len, unsigned int *key) {
+    unsigned int i=0;
+    unsigned int messages=0;
+    unsigned char status=0;
+    int rings=1;
+    int segments=1;
+    xt_priority_t pri=XT_PRI_BULK;
+    xt_priority_t msgpri;
+
+    *key=0;
+    if (buffer[0]==0xf0) {
+        if ((len==22)&&(buffer[1]==0x00)&&(buffer[2]==0x00)&&(buffer[3]==0x66)&&(buffer[4]==0x58)) {
+            *key=KEY_SCRIBBLE+(buffer[5]&0x0f);
+            return XT_PRI_TEXT;
+        }
+        if ((len==7)&&(buffer[4]==0x14)) *key=KEY_IDLE;
+        return XT_PRI_CONTROL;
+    }
+
+    // Walk every message, following running status, and take the most urgent
+    while (i<len) {
+        if (buffer[i]&0x80) status=buffer[i++];
+        if (i>=len) break;
+        switch (status&0xf0) {
+            case 0x90:
+                    msgpri=XT_PRI_BUTTON;
+                    break;
+            case 0xe0:
+                    msgpri=XT_PRI_FADER;
+                    break;
+            case 0xd0:
+                    msgpri=XT_PRI_METER;
+                    break;
+            case 0xb0:
+                    if ((buffer[i]>=0x30)&&(buffer[i]<=0x3f)) {
+                        msgpri=XT_PRI_RING;
+                        segments=0;
+                    } else if ((buffer[i]>=0x60)&&(buffer[i]<=0x7b)) {
+                        msgpri=XT_PRI_TEXT;
+                        rings=0;
+                    } else {
+                        msgpri=XT_PRI_BULK;
+                        rings=segments=0;
+                    }
+                    break;
+            default:
+                    // SysEx or something we don't know the length of
+                    return XT_PRI_BULK;
+        }
+        if (msgpri<pri) pri=msgpri;
+        messages++;
+        i+=((status&0xf0)==0xd0)?1:2;
+    }
+    if (i!=len) return XT_PRI_BULK;
+
+    // Full dumps would hold up the updates queued behind them
+    if (messages>XT_SCHED_BATCH_MESSAGES) return XT_PRI_BULK;
+
+    // Only updates that fully replace an earlier one get a key
+    switch (buffer[0]&0xf0) {
+        case 0xe0:
+                if (len==3) *key=KEY_FADER+(buffer[0]&0x0f);
+                break;
+        case 0x90:
+                if ((len==3)&&(buffer[0]==0x90)) *key=KEY_BUTTON+buffer[1];
+                break;
+        case 0xd0:
+                if ((len==9)&&(buffer[0]==0xd0)) *key=KEY_METERS;
+                break;
+        case 0xb0:
+                if ((buffer[0]!=0xb0)||(messages*2+1!=len)) break;
+                if (rings) *key=(len==5)?(KEY_RING+(buffer[1]&0x07)):(len==33)?KEY_ALLRINGS:0;
+                else if (segments) *key=(len==25)?KEY_SEGMENTS:0;
+                break;
+        default: break;
+    }
+    return pri;
+}
+
+// Returns 0 if the packet could never fit in the queue
+int XTouchScheduler::Enqueue(xt_priority_t pri, unsigned char *buffer, unsigned int len, unsigned int key) {
+    xt_sched_queue_t *q=&mQueues[pri];
+    xt_sched_entry_t *e;
+    unsigned int headoffset;
+    unsigned int offset;
+    unsigned int dropped=mDropped;
+    int i;
+
+    if (len>XT_SCHED_QUEUE_BYTES/2) return 0;
+    mSeq++;
+
+    // Replace an update for the same thing that hasn't gone yet
+    if (key) {
+        for(i=0;i<q->Count;i++) {
+            e=&q->Entries[(q->Head+i)%XT_SCHED_QUEUE_LEN];
+            if ((e->Key==key)&&(e->Len==len)) {
+                memcpy(q->Data+e->Offset,buffer,len);
+                e->Seq=mSeq;
+                if (mTrace) {
+                    e->Trace=mTrace->Current();
+                    e->Queued=XTouchTrace::Now();
+                }
+                return 1;
+            }
+        }
+    }
+
+    // Find room, throwing away the oldest packets in this class if need be
+    while (1) {
+        if (q->Count==0) q->DataTail=0;
+        if (q->Count<XT_SCHED_QUEUE_LEN) {
+            headoffset=q->Count?q->Entries[q->Head].Offset:0;
+            if ((q->Count==0)||(q->DataTail>headoffset)) {
+                if (q->DataTail+len<=XT_SCHED_QUEUE_BYTES) {
+                    offset=q->DataTail;
+                    break;
+                }
+                if (len<=headoffset) {
+                    offset=0;
+                    break;
+                }
+            } else if (q->DataTail+len<=headoffset) {
+                offset=q->DataTail;
+                break;
+            }
+        }
+        q->Head=(q->Head+1)%XT_SCHED_QUEUE_LEN;
+        q->Count--;
+        mDropped++;
+    }
+
+    e=&q->Entries[(q->Head+q->Count)%XT_SCHED_QUEUE_LEN];
+    e->Offset=offset;
+    e->Len=len;
+    e->Key=key;
+    e->Seq=mSeq;
+    e->Trace=mTrace?mTrace->Current():0;
+    e->Queued=mTrace?XTouchTrace::Now():0;
+    memcpy(q->Data+offset,buffer,len);
+    q->DataTail=offset+len;
+    q->Count++;
+    if ((mDropped!=dropped)&&(mDropCallbackHandler)) mDropCallbackHandler(mDropCallbackData,pri,mDropped);
+    return 1;
+}
+
+void XTouchScheduler::Transmit(xt_priority_t pri) {
+    xt_sched_queue_t *q=&mQueues[pri];
+    xt_sched_entry_t *e=&q->Entries[q->Head];
+    unsigned char *buffer=q->Data+e->Offset;
+    int64_t start;
+
+    Reconcile(buffer,e->Len,e->Seq);
+    q->Head=(q->Head+1)%XT_SCHED_QUEUE_LEN;
+    q->Count--;
+    if (!mTrace) {
+        mPacketSendHandler(mPPacketData,buffer,e->Len);
+        return;
+    }
+    start=XTouchTrace::Now();
+    mPacketSendHandler(mPPacketData,buffer,e->Len);
+    mTrace->Sent(XT_TRACE_SCHEDULER,"Transmit",e->Trace,start,e->Queued,buffer,e->Len);
+}
+
+void XTouchScheduler::Refill() {
+    int64_t now=NowUs();
+    double elapsed=(now-mLastRefill)/1000000.0;
+    mLastRefill=now;
+    mByteTokens+=elapsed*mBytesPerSec;
+    if (mByteTokens>mByteBurst) mByteTokens=mByteBurst;
+    mPacketTokens+=elapsed*mPacketsPerSec;
+    if (mPacketTokens>mPacketBurst) mPacketTokens=mPacketBurst;
+}
+
+// Classes overtake each other, so a packet can go out after one queued later for the same
+// button, controller or fader. Each value in a packet queued at seq is either patched with a
+// newer one already sent, or noted as the newest sent
+void XTouchScheduler::Reconcile(unsigned char *buffer, unsigned int len, uint32_t seq) {
+    unsigned int i=0;
+    unsigned char status=0;
+    unsigned char *sent;
+    int table;
+    int n;
+
+    while (i<len) {
+        if (buffer[i]==0xf0) {
+            while ((i<len)&&(buffer[i]!=0xf7)) i++;
+            i++;
+            status=0;
+            continue;
+        }
+        if (buffer[i]&0x80) status=buffer[i++];
+        if (i>=len) break;
+        switch (status&0xf0) {
+            case 0x90:
+            case 0xb0:
+            case 0xe0:
+                    if (i+1>=len) return;
+                    table=((status&0xf0)==0x90)?0:((status&0xf0)==0xb0)?1:2;
+                    n=(table==2)?(status&0x0f):(buffer[i]&0x7f);
+                    sent=(table==2)?&buffer[i]:&buffer[i+1];
+                    if ((int32_t)(mSentSeq[table][n]-seq)>0) {
+                        memcpy(sent,mSentData[table][n],(table==2)?2:1);
+                    } else {
+                        mSentSeq[table][n]=seq;
+                        memcpy(mSentData[table][n],sent,(table==2)?2:1);
+                    }
+                    i+=2;
+                    break;
+            case 0xc0:
+            case 0xd0:
+                    i+=1;
+                    break;
+            default:
+                    i+=2;
+                    break;
+        }
+    }
+}
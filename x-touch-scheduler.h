@@ -0,0 +1,129 @@
+/* ----------------------------------------------------------------
+                   x-touch-xctl library - output scheduler.
+   Sits between the XTouch class and the transport, pacing packets
+   to a bytes/packets per second budget so the X-Touch isn't flooded,
+   and sending the most important updates first so that interactive
+   feedback isn't stuck behind a full refresh.
+   ---------------------------------------------------------------- */
+
+/*
+MIT License
+
+Copyright (c) 2020 Martin Whitaker
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+/* Packets are sorted into priority classes by what they contain and each
+   class is sent in order, highest first. Updates that replace an earlier one
+   still waiting in the queue (the same fader, button, ring, scribble pad,
+   or the meters) overwrite it instead of queuing behind it. Batches go in
+   the class of their most urgent message, and full dumps go last. Since
+   classes overtake each other, every packet has any newer values that were
+   sent ahead of it patched in before it goes, so the X-Touch never ends up
+   showing stale state. If a queue overflows the oldest packets in it are
+   dropped and the drop callback asks for a full refresh.
+
+   Usage:
+     XTouchScheduler sched(XTouchTransport::SendHandler,(void*)transport);
+     XTouch board(XTouchScheduler::SendHandler,(void*)&sched);
+     sched.RegisterDropCallback(XTouch::RefreshHandler,(void*)&board);
+     while (1) {
+         transport->Poll(sched.NextDelay());
+         sched.Pump();
+     }
+*/
+
+#ifndef X_TOUCH_SCHEDULER_H
+#define X_TOUCH_SCHEDULER_H
+
+#include <stdint.h>
+#include "x-touch.h"
+
+enum xt_priority_t { XT_PRI_CONTROL, XT_PRI_FADER, XT_PRI_BUTTON, XT_PRI_METER, XT_PRI_RING, XT_PRI_TEXT, XT_PRI_BULK, XT_PRI_CLASSES };
+
+#define XT_SCHED_QUEUE_LEN 64       // Packets per priority class
+#define XT_SCHED_QUEUE_BYTES 8192   // Bytes per priority class
+#define XT_SCHED_BATCH_MESSAGES 32  // Packets with more messages than this are full dumps
+
+typedef struct {
+    unsigned int Offset;
+    unsigned int Len;
+    unsigned int Key;               // Non-zero if a later packet with the same key replaces this one
+    uint32_t Seq;
+    uint32_t Trace;                 // Trace ID of the packet that caused it, and when it was queued
+    int64_t Queued;
+} xt_sched_entry_t;
+
+typedef struct {
+    xt_sched_entry_t Entries[XT_SCHED_QUEUE_LEN];
+    int Head;
+    int Count;
+    unsigned int DataTail;
+    unsigned char Data[XT_SCHED_QUEUE_BYTES];
+} xt_sched_queue_t;
+
+class XTouchScheduler {
+    public:
+        XTouchScheduler(packet_sender PacketSendHandler, void *data);
+        ~XTouchScheduler();
+
+        static void SendHandler(void *scheduler, unsigned char *buffer, unsigned int len);
+
+        void SetRate(unsigned int bytespersec, unsigned int packetspersec);
+        void SetTrace(XTouchTrace *trace);
+        void RegisterDropCallback(callback Handler, void *data);
+        void Send(unsigned char *buffer, unsigned int len);
+        void Pump();
+        int NextDelay();
+        int Pending();
+        unsigned int Dropped();
+
+    private:
+        static xt_priority_t Classify(unsigned char *buffer, unsigned int len, unsigned int *key);
+        int Enqueue(xt_priority_t pri, unsigned char *buffer, unsigned int len, unsigned int key);
+        void Transmit(xt_priority_t pri);
+        void Refill();
+        void Reconcile(unsigned char *buffer, unsigned int len, uint32_t seq);
+
+        packet_sender mPacketSendHandler;
+        void *mPPacketData;
+        XTouchTrace *mTrace;
+
+        xt_sched_queue_t mQueues[XT_PRI_CLASSES];
+        uint32_t mSeq;
+        unsigned int mDropped;
+        callback mDropCallbackHandler;
+        void *mDropCallbackData;
+
+        // Token buckets. Zero rates mean unlimited
+        unsigned int mBytesPerSec;
+        unsigned int mPacketsPerSec;
+        double mByteTokens;
+        double mPacketTokens;
+        double mByteBurst;
+        double mPacketBurst;
+        int64_t mLastRefill;
+
+        // Newest value sent for each note, controller and fader, and when it was queued, for Reconcile()
+        uint32_t mSentSeq[3][128];
+        unsigned char mSentData[3][128][2];
+};
+
+#endif
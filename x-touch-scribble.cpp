@@ -0,0 +1,228 @@
+/* ----------------------------------------------------------------
+                   x-touch-xctl library - scribble text engine.
+   Shows text longer than the 7 characters a scribble pad can hold
+   by scrolling it, alternating between pages of text, and putting
+   temporary overlays (e.g. a value whilst a control is moved) over
+   the top of either line.
+   ---------------------------------------------------------------- */
+
+/*
+MIT License
+
+Copyright (c) 2020 Martin Whitaker
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#include "x-touch-scribble.h"
+#include <string.h>
+
+// Public interfaces
+XTouchScribble::XTouchScribble(XTouch *board) {
+    int i;
+    mBoard=board;
+    memset(mStrips,0,sizeof(mStrips));
+    for(i=0;i<8;i++) {
+        mStrips[i].PageCount=1;
+        mStrips[i].Colour=WHITE;
+    }
+    mTicks=0;
+    mDirty=0xff;
+    // Scroll a character every 300ms, pausing for a second at the start, and change pages every 2 seconds
+    SetTiming(3,10,20);
+}
+
+XTouchScribble::~XTouchScribble() {
+
+}
+
+// All in ticks of XT_SCRIBBLE_TICK_MS
+// scrollticks = time per character when scrolling
+// pauseticks = time to hold the start of the text before scrolling it
+// pageticks = time each page is shown for
+void XTouchScribble::SetTiming(int scrollticks, int pauseticks, int pageticks) {
+    mScrollTicks=(scrollticks<1)?1:scrollticks;
+    mPauseTicks=(pauseticks<0)?0:pauseticks;
+    mPageTicks=(pageticks<1)?1:pageticks;
+}
+
+// Sets the text for a strip with only one page
+// Text that is the same as before carries on scrolling from where it was
+void XTouchScribble::SetText(int strip, const char *top, const char *bottom) {
+    if ((strip<0)||(strip>7)) return;
+    SetPageCount(strip,1);
+    SetPage(strip,0,top,bottom);
+}
+
+// Sets the text for one page of a strip, adding the page if needed
+void XTouchScribble::SetPage(int strip, int page, const char *top, const char *bottom) {
+    xt_scribble_strip_t *s;
+    if ((strip<0)||(strip>7)||(page<0)||(page>=XT_SCRIBBLE_PAGES)) return;
+    s=&mStrips[strip];
+    SetLine(&s->Lines[page][0],top);
+    SetLine(&s->Lines[page][1],bottom);
+    if (page>=s->PageCount) s->PageCount=page+1;
+    mDirty|=1<<strip;
+}
+
+// Drops any pages after count
+void XTouchScribble::SetPageCount(int strip, int count) {
+    xt_scribble_strip_t *s;
+    if ((strip<0)||(strip>7)||(count<1)||(count>XT_SCRIBBLE_PAGES)) return;
+    s=&mStrips[strip];
+    s->PageCount=count;
+    if (s->Page>=count) {
+        s->Page=0;
+        s->PageTimer=0;
+        RestartLine(&s->Lines[0][0]);
+        RestartLine(&s->Lines[0][1]);
+    }
+    mDirty|=1<<strip;
+}
+
+void XTouchScribble::SetColour(int strip, xt_colours_t colour, int inverted) {
+    if ((strip<0)||(strip>7)) return;
+    mStrips[strip].Colour=colour;
+    mStrips[strip].Inverted=inverted;
+    mDirty|=1<<strip;
+}
+
+// Shows up to 7 characters over a line for the given number of ticks
+// A NULL line is left showing the strip's own text
+// Showing another overlay before this one has gone replaces it and restarts the time
+void XTouchScribble::ShowOverlay(int strip, const char *top, const char *bottom, int ticks) {
+    xt_scribble_strip_t *s;
+    if ((strip<0)||(strip>7)) return;
+    s=&mStrips[strip];
+    s->OverlayLines=0;
+    if (top) {
+        strncpy(s->Overlay[0],top,7);
+        s->Overlay[0][7]=0;
+        s->OverlayLines|=1;
+    }
+    if (bottom) {
+        strncpy(s->Overlay[1],bottom,7);
+        s->Overlay[1][7]=0;
+        s->OverlayLines|=2;
+    }
+    s->OverlayTimer=ticks;
+    mDirty|=1<<strip;
+}
+
+void XTouchScribble::ClearOverlay(int strip) {
+    if ((strip<0)||(strip>7)) return;
+    mStrips[strip].OverlayLines=0;
+    mDirty|=1<<strip;
+}
+
+// Moves the scrolling text, pages and overlays on by one tick
+void XTouchScribble::Tick() {
+    xt_scribble_strip_t *s;
+    xt_scribble_line_t *line;
+    int strip;
+    int i;
+
+    mTicks++;
+    for(strip=0;strip<8;strip++) {
+        s=&mStrips[strip];
+        if ((s->OverlayLines)&&(--s->OverlayTimer<=0)) {
+            s->OverlayLines=0;
+        }
+        if ((s->PageCount>1)&&(++s->PageTimer>=mPageTicks)) {
+            s->PageTimer=0;
+            s->Page=(s->Page+1)%s->PageCount;
+            RestartLine(&s->Lines[s->Page][0]);
+            RestartLine(&s->Lines[s->Page][1]);
+        }
+        for(i=0;i<2;i++) {
+            line=&s->Lines[s->Page][i];
+            if (line->Len<=7) continue;
+            if (line->Hold>0) {
+                line->Hold--;
+            } else if ((mTicks%mScrollTicks)==0) {
+                line->Offset=(line->Offset+1)%(line->Len+XT_SCRIBBLE_GAP);
+                if (line->Offset==0) line->Hold=mPauseTicks;
+            }
+        }
+        Render(strip);
+    }
+    mDirty=0;
+}
+
+// Draws the strips changed since the last Tick() or Update()
+void XTouchScribble::Update() {
+    int strip;
+    for(strip=0;strip<8;strip++) {
+        if (mDirty&(1<<strip)) Render(strip);
+    }
+    mDirty=0;
+}
+
+// ----------------------------------------------------------------------------------------------
+// Private functions
+// ----------------------------------------------------------------------------------------------
+
+void XTouchScribble::SetLine(xt_scribble_line_t *line, const char *text) {
+    if (!text) text="";
+    if (strncmp(line->Text,text,XT_SCRIBBLE_TEXT_LEN-1)==0) return;
+    strncpy(line->Text,text,XT_SCRIBBLE_TEXT_LEN-1);
+    line->Text[XT_SCRIBBLE_TEXT_LEN-1]=0;
+    line->Len=strlen(line->Text);
+    RestartLine(line);
+}
+
+void XTouchScribble::RestartLine(xt_scribble_line_t *line) {
+    line->Offset=0;
+    line->Hold=mPauseTicks;
+}
+
+// out must have room for 8 characters
+void XTouchScribble::RenderLine(xt_scribble_line_t *line, char *out) {
+    int i;
+    int n;
+    if (line->Len<=7) {
+        memcpy(out,line->Text,8);
+        return;
+    }
+    for(i=0;i<7;i++) {
+        n=(line->Offset+i)%(line->Len+XT_SCRIBBLE_GAP);
+        out[i]=(n<line->Len)?line->Text[n]:' ';
+    }
+    out[7]=0;
+}
+
+void XTouchScribble::Render(int strip) {
+    xt_scribble_strip_t *s=&mStrips[strip];
+    xt_ScribblePad_t pad;
+
+    memset(&pad,0,sizeof(pad));
+    if (s->OverlayLines&1) {
+        memcpy(pad.TopText,s->Overlay[0],8);
+    } else {
+        RenderLine(&s->Lines[s->Page][0],pad.TopText);
+    }
+    if (s->OverlayLines&2) {
+        memcpy(pad.BotText,s->Overlay[1],8);
+    } else {
+        RenderLine(&s->Lines[s->Page][1],pad.BotText);
+    }
+    pad.Colour=s->Colour;
+    pad.Inverted=s->Inverted;
+    mBoard->SetScribble(strip,pad);
+}
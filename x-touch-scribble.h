@@ -0,0 +1,105 @@
+/* ----------------------------------------------------------------
+                   x-touch-xctl library - scribble text engine.
+   Shows text longer than the 7 characters a scribble pad can hold
+   by scrolling it, alternating between pages of text, and putting
+   temporary overlays (e.g. a value whilst a control is moved) over
+   the top of either line.
+   ---------------------------------------------------------------- */
+
+/*
+MIT License
+
+Copyright (c) 2020 Martin Whitaker
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+/* Call Tick() every XT_SCRIBBLE_TICK_MS to animate the pads. Changes made with
+   the Set functions are drawn on the next Tick(), or straight away by calling
+   Update(). A pad is only sent to the X-Touch when what it shows actually changes
+   (see XTouch::SetScribble).
+
+   Usage:
+     XTouchScribble scribble(&board);
+     scribble.SetText(0,"PAN","Overhead Mic Left");   // Bottom line scrolls
+     scribble.ShowOverlay(0,"-3.5dB",NULL,10);        // Replaces the top line for 1 second
+     scribble.Update();
+     ... every 100ms: scribble.Tick();
+*/
+
+#ifndef X_TOUCH_SCRIBBLE_H
+#define X_TOUCH_SCRIBBLE_H
+
+#include "x-touch.h"
+
+#define XT_SCRIBBLE_TICK_MS 100
+#define XT_SCRIBBLE_TEXT_LEN 64     // Longest line of text, including the null
+#define XT_SCRIBBLE_PAGES 4         // Pages per strip
+#define XT_SCRIBBLE_GAP 3           // Spaces between the end of scrolling text and its start coming round again
+
+typedef struct {
+    char Text[XT_SCRIBBLE_TEXT_LEN];
+    int Len;
+    int Offset;                     // First character shown when scrolling
+    int Hold;                       // Ticks left to pause before scrolling
+} xt_scribble_line_t;
+
+typedef struct {
+    xt_scribble_line_t Lines[XT_SCRIBBLE_PAGES][2];     // Top and bottom line of each page
+    int PageCount;
+    int Page;
+    int PageTimer;
+    char Overlay[2][8];
+    int OverlayLines;               // Bit 0 for the top line, bit 1 for the bottom line
+    int OverlayTimer;
+    xt_colours_t Colour;
+    int Inverted;
+} xt_scribble_strip_t;
+
+class XTouchScribble {
+    public:
+        XTouchScribble(XTouch *board);
+        ~XTouchScribble();
+
+        void SetTiming(int scrollticks, int pauseticks, int pageticks);
+        void SetText(int strip, const char *top, const char *bottom);
+        void SetPage(int strip, int page, const char *top, const char *bottom);
+        void SetPageCount(int strip, int count);
+        void SetColour(int strip, xt_colours_t colour, int inverted=0);
+        void ShowOverlay(int strip, const char *top, const char *bottom, int ticks);
+        void ClearOverlay(int strip);
+        void Tick();
+        void Update();
+
+    private:
+        void SetLine(xt_scribble_line_t *line, const char *text);
+        void RestartLine(xt_scribble_line_t *line);
+        void RenderLine(xt_scribble_line_t *line, char *out);
+        void Render(int strip);
+
+        XTouch *mBoard;
+        xt_scribble_strip_t mStrips[8];
+        unsigned int mTicks;
+        int mScrollTicks;
+        int mPauseTicks;
+        int mPageTicks;
+        unsigned int mDirty;        // Bit per strip changed since it was last drawn
+};
+
+#endif
@@ -0,0 +1,288 @@
+/* ----------------------------------------------------------------
+                   x-touch-xctl library - shared state.
+   Publishes the live state of the X-Touch (fader positions, touches,
+   buttons, lights, meters and the application's selected channel
+   and bank) in POSIX shared memory, so other processes such as an
+   audio engine or UI can read it without any calls to the kernel.
+   ---------------------------------------------------------------- */
+
+
+/*
+MIT License
+
+Copyright (c) 2020 Martin Whitaker
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#include "x-touch-shm.h"
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <signal.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+// Seq goes up by 2 for every state written, so whilst it's even it is always
+// twice Changes (wrapping at 32 bits). Readers use this to spot a new state
+// from Seq alone without copying anything
+
+// ----------------------------------------------------------------------------------------------
+// Publisher
+// ----------------------------------------------------------------------------------------------
+
+// Creates (or takes over from a writer that has gone) the shared memory block.
+// name must start with / e.g. "/x-touch". Returns NULL on error or if another writer is running
+XTouchShmPublisher *XTouchShmPublisher::Create(const char *name) {
+    xt_shm_block_t *block;
+    int fd;
+
+    if ((name[0]!='/')||(strlen(name)>=64)) {
+        printf("Shared memory name must start with / and be under 64 characters: %s\n",name);
+        return NULL;
+    }
+    fd=shm_open(name,O_CREAT|O_RDWR,0644);
+    if (fd<0) {
+        perror("ERROR creating shared memory");
+        return NULL;
+    }
+    if (ftruncate(fd,sizeof(xt_shm_block_t))<0) {
+        perror("ERROR sizing shared memory");
+        close(fd);
+        return NULL;
+    }
+    block=(xt_shm_block_t *)mmap(NULL,sizeof(xt_shm_block_t),PROT_READ|PROT_WRITE,MAP_SHARED,fd,0);
+    close(fd);
+    if (block==MAP_FAILED) {
+        perror("ERROR mapping shared memory");
+        return NULL;
+    }
+    if ((__atomic_load_n(&block->Magic,__ATOMIC_ACQUIRE)==XT_SHM_MAGIC)&&(block->WriterPid!=(uint32_t)getpid())&&
+        ((kill(block->WriterPid,0)==0)||(errno!=ESRCH))) {
+        printf("Shared memory %s is already being written by process %u\n",name,block->WriterPid);
+        munmap(block,sizeof(xt_shm_block_t));
+        return NULL;
+    }
+    return new XTouchShmPublisher(name,block);
+}
+
+XTouchShmPublisher::XTouchShmPublisher(const char *name, xt_shm_block_t *block) {
+    uint32_t seq=0;
+
+    strcpy(mName,name);
+    mBlock=block;
+    mDepth=0;
+    mDirty=0;
+    memset(&mState,0,sizeof(mState));
+    mState.Selected=-1;
+    mState.Bank=-1;
+
+    // Readers still attached to a block being taken over carry on from its Seq, so it keeps
+    // counting and is odd whilst the block is rewritten. New readers ignore the block until
+    // the magic number is back
+    if ((__atomic_load_n(&mBlock->Magic,__ATOMIC_ACQUIRE)==XT_SHM_MAGIC)&&(mBlock->Version==XT_SHM_VERSION)&&
+        (mBlock->Size==sizeof(xt_shm_block_t))) {
+        seq=__atomic_load_n(&mBlock->Seq,__ATOMIC_RELAXED);
+    }
+    seq|=1;
+    __atomic_store_n(&mBlock->Seq,seq,__ATOMIC_RELAXED);
+    __atomic_store_n(&mBlock->Magic,0,__ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    mBlock->Version=XT_SHM_VERSION;
+    mBlock->Size=sizeof(xt_shm_block_t);
+    mBlock->WriterPid=getpid();
+    mBlock->Reserved=0;
+    memcpy(&mBlock->State,&mState,sizeof(mState));
+    mBlock->Changes=(seq+1)/2;
+    __atomic_store_n(&mBlock->Seq,seq+1,__ATOMIC_RELEASE);
+    __atomic_store_n(&mBlock->Magic,XT_SHM_MAGIC,__ATOMIC_RELEASE);
+}
+
+// Readers that already have the block open can still read the last state
+XTouchShmPublisher::~XTouchShmPublisher() {
+    munmap(mBlock,sizeof(xt_shm_block_t));
+    shm_unlink(mName);
+}
+
+// Changes made until the matching EndUpdate() are published together
+void XTouchShmPublisher::BeginUpdate() {
+    mDepth++;
+}
+
+void XTouchShmPublisher::EndUpdate() {
+    if (mDepth==0) return;
+    mDepth--;
+    if (mDepth==0) Commit();
+}
+
+void XTouchShmPublisher::SetFader(int fader, int level) {
+    if ((fader<0)||(fader>8)||(mState.Faders[fader]==level)) return;
+    mState.Faders[fader]=level;
+    Changed();
+}
+
+void XTouchShmPublisher::SetTouched(int fader, int touched) {
+    uint32_t touches;
+    if ((fader<0)||(fader>8)) return;
+    touches=touched?(mState.Touched|(1u<<fader)):(mState.Touched&~(1u<<fader));
+    if (touches==mState.Touched) return;
+    mState.Touched=touches;
+    Changed();
+}
+
+void XTouchShmPublisher::SetPressed(int button, int pressed) {
+    uint32_t word;
+    if ((button<0)||(button>127)) return;
+    word=mState.Pressed[button>>5];
+    word=pressed?(word|(1u<<(button&31))):(word&~(1u<<(button&31)));
+    if (word==mState.Pressed[button>>5]) return;
+    mState.Pressed[button>>5]=word;
+    Changed();
+}
+
+void XTouchShmPublisher::SetLight(int button, int state) {
+    if ((button<0)||(button>127)||(mState.Lights[button]==state)) return;
+    mState.Lights[button]=state;
+    Changed();
+}
+
+void XTouchShmPublisher::SetMeter(int channel, int level) {
+    if ((channel<0)||(channel>7)||(mState.Meters[channel]==level)) return;
+    mState.Meters[channel]=level;
+    Changed();
+}
+
+void XTouchShmPublisher::SetSelected(int channel) {
+    if (mState.Selected==channel) return;
+    mState.Selected=channel;
+    Changed();
+}
+
+void XTouchShmPublisher::SetBank(int bank) {
+    if (mState.Bank==bank) return;
+    mState.Bank=bank;
+    Changed();
+}
+
+// ----------------------------------------------------------------------------------------------
+// Private functions
+// ----------------------------------------------------------------------------------------------
+
+void XTouchShmPublisher::Changed() {
+    mDirty=1;
+    if (mDepth==0) Commit();
+}
+
+void XTouchShmPublisher::Commit() {
+    struct timespec ts;
+    uint32_t seq;
+
+    if (!mDirty) return;
+    mDirty=0;
+    clock_gettime(CLOCK_MONOTONIC,&ts);
+    mState.Updated=(int64_t)ts.tv_sec*1000000000+ts.tv_nsec;
+
+    seq=__atomic_load_n(&mBlock->Seq,__ATOMIC_RELAXED);
+    __atomic_store_n(&mBlock->Seq,seq+1,__ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    memcpy(&mBlock->State,&mState,sizeof(mState));
+    mBlock->Changes++;
+    __atomic_store_n(&mBlock->Seq,seq+2,__ATOMIC_RELEASE);
+}
+
+// ----------------------------------------------------------------------------------------------
+// Reader
+// ----------------------------------------------------------------------------------------------
+
+// Opens the block published under name. Returns NULL if it isn't there or is a different layout
+XTouchShmReader *XTouchShmReader::Open(const char *name) {
+    xt_shm_block_t *block;
+    struct stat st;
+    int fd;
+
+    fd=shm_open(name,O_RDONLY,0);
+    if (fd<0) {
+        perror("ERROR opening shared memory");
+        return NULL;
+    }
+    if ((fstat(fd,&st)<0)||(st.st_size<(off_t)sizeof(xt_shm_block_t))) {
+        printf("Shared memory %s is too small\n",name);
+        close(fd);
+        return NULL;
+    }
+    block=(xt_shm_block_t *)mmap(NULL,sizeof(xt_shm_block_t),PROT_READ,MAP_SHARED,fd,0);
+    close(fd);
+    if (block==MAP_FAILED) {
+        perror("ERROR mapping shared memory");
+        return NULL;
+    }
+    if ((__atomic_load_n(&block->Magic,__ATOMIC_ACQUIRE)!=XT_SHM_MAGIC)||(block->Version!=XT_SHM_VERSION)||
+        (block->Size!=sizeof(xt_shm_block_t))) {
+        printf("Shared memory %s isn't an X-Touch state block of version %d\n",name,XT_SHM_VERSION);
+        munmap(block,sizeof(xt_shm_block_t));
+        return NULL;
+    }
+    return new XTouchShmReader(block);
+}
+
+XTouchShmReader::XTouchShmReader(const xt_shm_block_t *block) {
+    mBlock=block;
+}
+
+XTouchShmReader::~XTouchShmReader() {
+    munmap((void *)mBlock,sizeof(xt_shm_block_t));
+}
+
+// Copies out the latest state, and the number of states written up to it if changes isn't NULL
+// Returns 0 if the writer was busy the whole time (it only ever is for a few hundred ns)
+int XTouchShmReader::Read(xt_shm_state_t *state, uint64_t *changes) {
+    uint32_t before;
+    uint32_t after;
+    uint64_t count;
+    int tries;
+
+    for(tries=0;tries<1000;tries++) {
+        before=__atomic_load_n(&mBlock->Seq,__ATOMIC_ACQUIRE);
+        if (before&1) continue;
+        memcpy(state,(const void *)&mBlock->State,sizeof(xt_shm_state_t));
+        count=mBlock->Changes;
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        after=__atomic_load_n(&mBlock->Seq,__ATOMIC_RELAXED);
+        if (before==after) {
+            if (changes) *changes=count;
+            return 1;
+        }
+    }
+    return 0;
+}
+
+// As Read(), but returns 0 without copying anything if nothing has changed since lastchanges
+// lastchanges is updated to the state read, so start it at 0
+int XTouchShmReader::ReadIfChanged(xt_shm_state_t *state, uint64_t *lastchanges) {
+    if (__atomic_load_n(&mBlock->Seq,__ATOMIC_ACQUIRE)==(uint32_t)(*lastchanges*2)) return 0;
+    return Read(state,lastchanges);
+}
+
+// Returns the process ID of the writer, e.g. to check it's still running
+int XTouchShmReader::WriterPid() {
+    return mBlock->WriterPid;
+}
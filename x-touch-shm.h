@@ -0,0 +1,127 @@
+/* ----------------------------------------------------------------
+                   x-touch-xctl library - shared state.
+   Publishes the live state of the X-Touch (fader positions, touches,
+   buttons, lights, meters and the application's selected channel
+   and bank) in POSIX shared memory, so other processes such as an
+   audio engine or UI can read it without any calls to the kernel.
+   ---------------------------------------------------------------- */
+
+/*
+MIT License
+
+Copyright (c) 2020 Martin Whitaker
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+/* The block has a fixed layout, checked by readers against XT_SHM_MAGIC,
+   XT_SHM_VERSION and its size. It is protected by a seqlock: the writer makes
+   Seq odd whilst it copies in a new state and even again afterwards, and a reader
+   copies the state out and tries again if Seq was odd or changed meanwhile.
+   Readers never block the writer, and a new state is only written when
+   something has actually changed, counted by Changes.
+
+   Writer:
+     XTouchShmPublisher *pub=XTouchShmPublisher::Create("/x-touch");
+     board.SetPublisher(pub);            // The XTouch keeps it up to date
+     pub->SetSelected(3);                // Application state
+
+   Reader (in another process):
+     XTouchShmReader *r=XTouchShmReader::Open("/x-touch");
+     xt_shm_state_t state;
+     uint64_t last=0;
+     if (r->ReadIfChanged(&state,&last)) ... state.Faders[0]
+*/
+
+#ifndef X_TOUCH_SHM_H
+#define X_TOUCH_SHM_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define XT_SHM_MAGIC 0x48435458     // "XTCH"
+#define XT_SHM_VERSION 1
+
+typedef struct {
+    int32_t Faders[9];              // 0-16383, as last moved on the surface or set by the application
+    uint32_t Touched;               // Bit per fader being touched
+    uint32_t Pressed[4];            // Bit per button being held down
+    uint8_t Lights[128];            // xt_button_state_t of each button light
+    uint8_t Meters[8];              // 0-9
+    int32_t Selected;               // Application's selected channel, -1 if none
+    int32_t Bank;                   // Application's bank, -1 if none
+    int32_t Reserved;
+    int64_t Updated;                // CLOCK_MONOTONIC time of the last change, in ns
+} xt_shm_state_t;
+
+typedef struct {
+    uint32_t Magic;
+    uint32_t Version;
+    uint32_t Size;                  // sizeof(xt_shm_block_t)
+    uint32_t WriterPid;
+    uint32_t Seq;                   // Odd whilst being written
+    uint32_t Reserved;
+    uint64_t Changes;               // Number of states written
+    xt_shm_state_t State;
+} xt_shm_block_t;
+
+class XTouchShmPublisher {
+    public:
+        static XTouchShmPublisher *Create(const char *name);
+        ~XTouchShmPublisher();
+
+        void BeginUpdate();
+        void EndUpdate();
+
+        void SetFader(int fader, int level);
+        void SetTouched(int fader, int touched);
+        void SetPressed(int button, int pressed);
+        void SetLight(int button, int state);
+        void SetMeter(int channel, int level);
+        void SetSelected(int channel);
+        void SetBank(int bank);
+
+    private:
+        XTouchShmPublisher(const char *name, xt_shm_block_t *block);
+        void Changed();
+        void Commit();
+
+        char mName[64];
+        xt_shm_block_t *mBlock;
+        xt_shm_state_t mState;      // Staged here and copied to the block in one go
+        int mDepth;
+        int mDirty;
+};
+
+class XTouchShmReader {
+    public:
+        static XTouchShmReader *Open(const char *name);
+        ~XTouchShmReader();
+
+        int Read(xt_shm_state_t *state, uint64_t *changes=NULL);
+        int ReadIfChanged(xt_shm_state_t *state, uint64_t *lastchanges);
+        int WriterPid();
+
+    private:
+        XTouchShmReader(const xt_shm_block_t *block);
+
+        const xt_shm_block_t *mBlock;
+};
+
+#endif
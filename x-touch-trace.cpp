@@ -0,0 +1,229 @@
+/* ----------------------------------------------------------------
+                   x-touch-xctl library - latency tracing.
+   Follows each packet from the X-Touch through the callbacks and the
+   application to every packet sent back because of it, and writes
+   the timings as a Chrome trace (JSON) for viewing in Perfetto or
+   chrome://tracing.
+   ---------------------------------------------------------------- */
+
+
+/*
+MIT License
+
+Copyright (c) 2020 Martin Whitaker
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#include "x-touch-trace.h"
+#include <stdarg.h>
+#include <string.h>
+#include <time.h>
+
+// ----------------------------------------------------------------------------------------------
+// Public interfaces
+// ----------------------------------------------------------------------------------------------
+
+// Starts a trace file. Returns NULL on error
+XTouchTrace *XTouchTrace::Open(const char *filename) {
+    FILE *file;
+    file=fopen(filename,"w");
+    if (!file) {
+        perror("ERROR opening trace");
+        return NULL;
+    }
+    return new XTouchTrace(file);
+}
+
+XTouchTrace::XTouchTrace(FILE *file) {
+    mFile=file;
+    mEvents=0;
+    mNextId=0;
+    mCurrent=0;
+    mDatagram=0;
+    mFlows=0;
+    mLastFlush=Now();
+    mDepth=0;
+    memset(mIds,0,sizeof(mIds));
+    memset(mArrivals,0,sizeof(mArrivals));
+
+    fputs("[\n",mFile);
+    Event("{\"ph\":\"M\",\"name\":\"process_name\",\"pid\":1,\"args\":{\"name\":\"x-touch\"}}");
+    Event("{\"ph\":\"M\",\"name\":\"thread_name\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":\"Input\"}}",XT_TRACE_INPUT);
+    Event("{\"ph\":\"M\",\"name\":\"thread_name\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":\"Output\"}}",XT_TRACE_OUTPUT);
+    Event("{\"ph\":\"M\",\"name\":\"thread_name\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":\"Scheduler\"}}",XT_TRACE_SCHEDULER);
+}
+
+// Finishes the file
+XTouchTrace::~XTouchTrace() {
+    fputs("\n]\n",mFile);
+    fclose(mFile);
+}
+
+// CLOCK_MONOTONIC in ns
+int64_t XTouchTrace::Now() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC,&ts);
+    return (int64_t)ts.tv_sec*1000000000+ts.tv_nsec;
+}
+
+// A transport has received a datagram. Every message split from it, until EndDatagram(),
+// is given its ID and arrival time by Receive()
+uint32_t XTouchTrace::BeginDatagram() {
+    mNextId++;
+    if (mNextId==0) mNextId++;
+    mIds[mNextId&(XT_TRACE_HISTORY-1)]=mNextId;
+    mArrivals[mNextId&(XT_TRACE_HISTORY-1)]=Now();
+    mDatagram=mNextId;
+    return mNextId;
+}
+
+void XTouchTrace::EndDatagram() {
+    mDatagram=0;
+}
+
+// A packet has arrived from the X-Touch. Returns its ID, which is now current
+uint32_t XTouchTrace::Receive() {
+    if (mDatagram) {
+        mCurrent=mDatagram;
+    } else {
+        mCurrent=BeginDatagram();
+        EndDatagram();
+    }
+    mDepth=0;
+    return mCurrent;
+}
+
+// The packet has been handled (its callbacks have returned)
+void XTouchTrace::Received(uint32_t id, const unsigned char *buffer, unsigned int len) {
+    const char *name="Packet";
+    char msg[64];
+    int64_t arrival;
+
+    arrival=Arrival(id);
+    if (arrival<0) return;
+    if ((len>0)&&(buffer[0]==0x90)) name=((len>1)&&(buffer[1]>=0x68)&&(buffer[1]<=0x70))?"Touch":"Button";
+    if ((len>0)&&(buffer[0]==0xb0)) name="Dial";
+    if ((len>0)&&((buffer[0]&0xf0)==0xe0)) name="Fader";
+    if ((len>0)&&(buffer[0]==0xf0)) name="SysEx";
+    Describe(buffer,len,msg,sizeof(msg));
+    Event("{\"ph\":\"X\",\"name\":\"%s\",\"cat\":\"input\",\"pid\":1,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f,\"args\":{\"id\":%u,\"msg\":\"%s\"}}",
+          name,XT_TRACE_INPUT,arrival/1000.0,(Now()-arrival)/1000.0,id,msg);
+}
+
+// The ID that packets sent now are tagged with, 0 if none
+uint32_t XTouchTrace::Current() {
+    return mCurrent;
+}
+
+// Makes id current again, e.g. for work done later on behalf of that packet
+void XTouchTrace::SetCurrent(uint32_t id) {
+    mCurrent=id;
+}
+
+// Call when whatever a packet caused has been done, so later packets aren't tagged with it
+void XTouchTrace::Idle() {
+    int64_t now;
+    mCurrent=0;
+    mDepth=0;
+    now=Now();
+    if (now-mLastFlush>=1000000000) {
+        fflush(mFile);
+        mLastFlush=now;
+    }
+}
+
+// Marks a stage of the application's handling of the current packet, e.g. "Render"
+void XTouchTrace::BeginSpan(const char *name) {
+    if (mDepth<XT_TRACE_SPANS) {
+        mSpans[mDepth].Name=name;
+        mSpans[mDepth].Start=Now();
+    }
+    mDepth++;
+}
+
+void XTouchTrace::EndSpan() {
+    xt_trace_span_t *span;
+    if (mDepth==0) return;
+    mDepth--;
+    if ((mDepth>=XT_TRACE_SPANS)||(mCurrent==0)) return;
+    span=&mSpans[mDepth];
+    Event("{\"ph\":\"X\",\"name\":\"%s\",\"cat\":\"app\",\"pid\":1,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f,\"args\":{\"id\":%u}}",
+          span->Name,XT_TRACE_INPUT,span->Start/1000.0,(Now()-span->Start)/1000.0,mCurrent);
+}
+
+// A packet caused by id was sent from start until now, having been queued since queued (0 if it wasn't)
+void XTouchTrace::Sent(xt_trace_track_t track, const char *name, uint32_t id, int64_t start, int64_t queued, const unsigned char *buffer, unsigned int len) {
+    char msg[64];
+    int64_t arrival;
+    int64_t now;
+
+    if (id==0) return;
+    arrival=Arrival(id);
+    if (arrival<0) return;
+    now=Now();
+    Describe(buffer,len,msg,sizeof(msg));
+    Event("{\"ph\":\"X\",\"name\":\"%s\",\"cat\":\"output\",\"pid\":1,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f,"
+          "\"args\":{\"id\":%u,\"bytes\":%u,\"msg\":\"%s\",\"latency_us\":%.1f,\"queued_us\":%.1f}}",
+          name,track,start/1000.0,(now-start)/1000.0,id,len,msg,(now-arrival)/1000.0,queued?(start-queued)/1000.0:0.0);
+    // An arrow from the packet that caused it
+    mFlows++;
+    Event("{\"ph\":\"s\",\"name\":\"feedback\",\"cat\":\"flow\",\"id\":%u,\"pid\":1,\"tid\":%d,\"ts\":%.3f}",
+          mFlows,XT_TRACE_INPUT,arrival/1000.0);
+    Event("{\"ph\":\"f\",\"bp\":\"e\",\"name\":\"feedback\",\"cat\":\"flow\",\"id\":%u,\"pid\":1,\"tid\":%d,\"ts\":%.3f}",
+          mFlows,track,start/1000.0);
+}
+
+// Number of events written so far
+unsigned int XTouchTrace::Events() {
+    return mEvents;
+}
+
+// ----------------------------------------------------------------------------------------------
+// Private functions
+// ----------------------------------------------------------------------------------------------
+
+void XTouchTrace::Event(const char *format, ...) {
+    va_list args;
+    if (mEvents>0) fputs(",\n",mFile);
+    va_start(args,format);
+    vfprintf(mFile,format,args);
+    va_end(args);
+    mEvents++;
+}
+
+// When id arrived, or -1 if it's too long ago to remember
+int64_t XTouchTrace::Arrival(uint32_t id) {
+    if ((id==0)||(mIds[id&(XT_TRACE_HISTORY-1)]!=id)) return -1;
+    return mArrivals[id&(XT_TRACE_HISTORY-1)];
+}
+
+// The first few bytes in hex, e.g. "90 5e 7f"
+void XTouchTrace::Describe(const unsigned char *buffer, unsigned int len, char *out, int size) {
+    unsigned int i;
+    int used=0;
+    out[0]=0;
+    for(i=0;(i<len)&&(used+4<size);i++) {
+        if ((i==12)&&(len>13)) {
+            snprintf(out+used,size-used,"%s...",used?" ":"");
+            return;
+        }
+        used+=snprintf(out+used,size-used,"%s%02x",used?" ":"",buffer[i]);
+    }
+}
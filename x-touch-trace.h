@@ -0,0 +1,120 @@
+/* ----------------------------------------------------------------
+                   x-touch-xctl library - latency tracing.
+   Follows each packet from the X-Touch through the callbacks and the
+   application to every packet sent back because of it, and writes
+   the timings as a Chrome trace (JSON) for viewing in Perfetto or
+   chrome://tracing.
+   ---------------------------------------------------------------- */
+
+
+/*
+MIT License
+
+Copyright (c) 2020 Martin Whitaker
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+/* Every datagram (or read) a transport with a trace receives gets a trace ID
+   and the time it arrived, which every message split from it shares. Packets
+   given to XTouch::HandlePacket some other way get their own. The ID stays
+   current whilst the callbacks and whatever the application does afterwards
+   run, until the application calls Idle(), so every packet sent in the
+   meantime is tagged with it. The scheduler carries the ID along with queued
+   packets, so the trace shows:
+     Input      a slice per packet received, covering its callbacks, and any
+                spans the application marks with BeginSpan()/EndSpan()
+     Output     a slice per packet the XTouch sends (or batch it flushes)
+     Scheduler  a slice per packet sent to the X-Touch, with how long it queued
+   with an arrow from each input to every output it caused. Output and
+   Scheduler slices give latency_us, the time since the packet that caused
+   them arrived. Packets not caused by one (timers, meters) have no ID and
+   aren't traced.
+
+   Usage:
+     XTouchTrace *trace=XTouchTrace::Open("session.json");
+     transport->SetTrace(trace);
+     board.SetTrace(trace);
+     sched.SetTrace(trace);
+     ... in the receive callback:
+         board.HandlePacket(buffer,len);
+         trace->BeginSpan("Render");
+         Render();
+         trace->EndSpan();
+     ... in the main loop, before timers run: trace->Idle();
+     delete trace;                       // Finishes the file
+*/
+
+#ifndef X_TOUCH_TRACE_H
+#define X_TOUCH_TRACE_H
+
+#include <stdio.h>
+#include <stdint.h>
+
+enum xt_trace_track_t { XT_TRACE_INPUT=1, XT_TRACE_OUTPUT, XT_TRACE_SCHEDULER };
+
+#define XT_TRACE_SPANS 16           // Nesting depth of BeginSpan()
+#define XT_TRACE_HISTORY 4096       // IDs whose arrival time is kept (power of 2)
+
+typedef struct {
+    const char *Name;
+    int64_t Start;
+} xt_trace_span_t;
+
+class XTouchTrace {
+    public:
+        static XTouchTrace *Open(const char *filename);
+        ~XTouchTrace();
+
+        static int64_t Now();
+
+        uint32_t BeginDatagram();
+        void EndDatagram();
+        uint32_t Receive();
+        void Received(uint32_t id, const unsigned char *buffer, unsigned int len);
+        uint32_t Current();
+        void SetCurrent(uint32_t id);
+        void Idle();
+        void BeginSpan(const char *name);
+        void EndSpan();
+        void Sent(xt_trace_track_t track, const char *name, uint32_t id, int64_t start, int64_t queued, const unsigned char *buffer, unsigned int len);
+        unsigned int Events();
+
+    private:
+        XTouchTrace(FILE *file);
+        void Event(const char *format, ...) __attribute__((format(printf,2,3)));
+        int64_t Arrival(uint32_t id);
+        static void Describe(const unsigned char *buffer, unsigned int len, char *out, int size);
+
+        FILE *mFile;
+        unsigned int mEvents;
+        uint32_t mNextId;
+        uint32_t mCurrent;
+        uint32_t mDatagram;
+        uint32_t mFlows;
+        int64_t mLastFlush;
+
+        xt_trace_span_t mSpans[XT_TRACE_SPANS];
+        int mDepth;
+
+        uint32_t mIds[XT_TRACE_HISTORY];
+        int64_t mArrivals[XT_TRACE_HISTORY];
+};
+
+#endif
@@ -0,0 +1,364 @@
+/* ----------------------------------------------------------------
+                   x-touch-xctl library - transports.
+   Carries Xctl messages between the XTouch class and the X-Touch,
+   either as UDP datagrams (the X-Touch's own network interface) or
+   as a byte stream over a pipe, pty or TCP connection, e.g. to a
+   MIDI bridge process.
+   ---------------------------------------------------------------- */
+
+/*
+MIT License
+
+Copyright (c) 2020 Martin Whitaker
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#include "x-touch-transport.h"
+#include "x-touch-trace.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <netdb.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+
+// Number of bytes in a channel message with this status byte, including the status byte
+static unsigned int MessageLength(unsigned char status) {
+    if (((status&0xf0)==0xc0)||((status&0xf0)==0xd0)) return 2;
+    return 3;
+}
+
+// ----------------------------------------------------------------------------------------------
+// XTouchTransport - common to all transports
+// ----------------------------------------------------------------------------------------------
+
+XTouchTransport::XTouchTransport() {
+    mReceiveCallbackHandler=NULL;
+    mTrace=NULL;
+    mRunningStatus=0;
+}
+
+XTouchTransport::~XTouchTransport() {
+
+}
+
+// Creates a transport from a spec string (see x-touch-transport.h)
+// Returns NULL if it can't be opened
+XTouchTransport *XTouchTransport::Open(const char *spec) {
+    struct sockaddr_in serveraddr;
+    struct addrinfo hints;
+    struct addrinfo *res;
+    char host[256];
+    const char *port;
+    int fd;
+    int optval;
+
+    if ((strcmp(spec,"udp")==0)||(strncmp(spec,"udp:",4)==0)) {
+        fd = socket(AF_INET, SOCK_DGRAM, 0);
+        if (fd < 0) {
+            perror("ERROR opening socket");
+            return NULL;
+        }
+        optval = 1;
+        setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, (const void *)&optval , sizeof(int));
+        memset(&serveraddr, 0, sizeof(serveraddr));
+        serveraddr.sin_family = AF_INET;
+        serveraddr.sin_addr.s_addr = htonl(INADDR_ANY);
+        serveraddr.sin_port = htons((unsigned short)((spec[3]==':')?atoi(spec+4):10111));
+        if (bind(fd, (struct sockaddr *) &serveraddr, sizeof(serveraddr)) < 0) {
+            perror("ERROR on binding");
+            close(fd);
+            return NULL;
+        }
+        return new XTouchUdpTransport(fd);
+    }
+
+    if (strncmp(spec,"tcp:",4)==0) {
+        port=strrchr(spec+4,':');
+        if ((!port)||(port-(spec+4)>=(int)sizeof(host))) {
+            fprintf(stderr,"Expected tcp:<host>:<port>\n");
+            return NULL;
+        }
+        memcpy(host,spec+4,port-(spec+4));
+        host[port-(spec+4)]=0;
+        memset(&hints, 0, sizeof(hints));
+        hints.ai_family = AF_UNSPEC;
+        hints.ai_socktype = SOCK_STREAM;
+        if (getaddrinfo(host, port+1, &hints, &res) != 0) {
+            fprintf(stderr,"Unknown host %s\n",host);
+            return NULL;
+        }
+        fd = socket(res->ai_family, res->ai_socktype, res->ai_protocol);
+        if ((fd < 0)||(connect(fd, res->ai_addr, res->ai_addrlen) < 0)) {
+            perror("ERROR connecting");
+            if (fd >= 0) close(fd);
+            freeaddrinfo(res);
+            return NULL;
+        }
+        freeaddrinfo(res);
+        optval = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, (const void *)&optval , sizeof(int));
+        return new XTouchStreamTransport(fd,fd);
+    }
+
+    if (strncmp(spec,"file:",5)==0) {
+        fd = open(spec+5, O_RDWR|O_NOCTTY);
+        if (fd < 0) {
+            perror(spec+5);
+            return NULL;
+        }
+        return new XTouchStreamTransport(fd,fd);
+    }
+
+    if (strcmp(spec,"stdio")==0) {
+        // Anything the application prints would corrupt the stream, so send it to stderr instead
+        fd = dup(1);
+        if (fd < 0) {
+            perror("ERROR duplicating stdout");
+            return NULL;
+        }
+        dup2(2,1);
+        return new XTouchStreamTransport(0,fd);
+    }
+
+    fprintf(stderr,"Unknown transport %s\n",spec);
+    return NULL;
+}
+
+// Pass this to the XTouch constructor, with the transport as the user pointer
+void XTouchTransport::SendHandler(void *transport, unsigned char *buffer, unsigned int len) {
+    ((XTouchTransport *)transport)->Send(buffer,len);
+}
+
+// The handler registered here will be called for every message received
+// Normally this just passes the message on to XTouch::HandlePacket()
+void XTouchTransport::RegisterReceiveCallback(packet_receiver Handler, void *data) {
+    mReceiveCallbackHandler=Handler;
+    mReceiveCallbackData=data;
+}
+
+// Datagrams received are stamped in the trace given here (see x-touch-trace.h). NULL stops it
+void XTouchTransport::SetTrace(XTouchTrace *trace) {
+    mTrace=trace;
+}
+
+// Forgets the running status, e.g. at the start of a new datagram
+void XTouchTransport::ResetFraming() {
+    mRunningStatus=0;
+}
+
+// Splits buffer into MIDI messages and passes each one to the receive callback
+// Messages are passed on in place, except running status messages which have
+// their status byte put back in a small scratch buffer
+// Returns the number of bytes used - anything after that is an incomplete message
+unsigned int XTouchTransport::Frame(unsigned char *buffer, unsigned int len, int *count) {
+    unsigned int pos=0;
+    unsigned int need;
+    unsigned int i;
+    unsigned char *end;
+    unsigned char b;
+
+    *count=0;
+    if (mTrace) mTrace->BeginDatagram();
+    while (pos<len) {
+        b=buffer[pos];
+        if (b>=0xf8) {
+            // Real time messages - not used by Xctl
+            pos++;
+            continue;
+        }
+        if (b==0xf0) {
+            end=(unsigned char *)memchr(buffer+pos,0xf7,len-pos);
+            if (!end) break;
+            need=end-(buffer+pos)+1;
+            if (mReceiveCallbackHandler) mReceiveCallbackHandler(mReceiveCallbackData,buffer+pos,need);
+            (*count)++;
+            pos+=need;
+            mRunningStatus=0;
+            continue;
+        }
+        if (b>0xf0) {
+            // Other system common messages cancel running status
+            mRunningStatus=0;
+            pos++;
+            continue;
+        }
+        if (b&0x80) {
+            need=MessageLength(b);
+            if (pos+need>len) break;
+            for(i=1;i<need;i++) {
+                if (buffer[pos+i]&0x80) break;
+            }
+            if (i<need) {
+                // Truncated message - resynchronise on the next status byte
+                pos+=i;
+                continue;
+            }
+            mRunningStatus=b;
+            if (mReceiveCallbackHandler) mReceiveCallbackHandler(mReceiveCallbackData,buffer+pos,need);
+            (*count)++;
+            pos+=need;
+            continue;
+        }
+        if (!mRunningStatus) {
+            // Data byte with nothing to belong to
+            pos++;
+            continue;
+        }
+        need=MessageLength(mRunningStatus)-1;
+        if (pos+need>len) break;
+        for(i=0;i<need;i++) {
+            if (buffer[pos+i]&0x80) break;
+        }
+        if (i<need) {
+            pos+=i;
+            continue;
+        }
+        mScratch[0]=mRunningStatus;
+        memcpy(mScratch+1,buffer+pos,need);
+        if (mReceiveCallbackHandler) mReceiveCallbackHandler(mReceiveCallbackData,mScratch,need+1);
+        (*count)++;
+        pos+=need;
+    }
+    if (mTrace) mTrace->EndDatagram();
+    return pos;
+}
+
+// ----------------------------------------------------------------------------------------------
+// XTouchUdpTransport
+// ----------------------------------------------------------------------------------------------
+
+// sockfd must already be bound to the port the X-Touch sends to
+// Replies go to wherever the last packet came from
+XTouchUdpTransport::XTouchUdpTransport(int sockfd) {
+    mSockfd=sockfd;
+    mConnected=0;
+    mClientLen=sizeof(mClientAddr);
+    memset(&mClientAddr,0,sizeof(mClientAddr));
+}
+
+XTouchUdpTransport::~XTouchUdpTransport() {
+    close(mSockfd);
+}
+
+// Waits up to timeout ms (-1 = forever) for packets and passes on every message received
+// Returns the number of messages, or -1 on error (errno is EINTR if interrupted by a signal)
+int XTouchUdpTransport::Poll(int timeout) {
+    struct pollfd fds;
+    socklen_t clientlen;
+    struct sockaddr_in clientaddr;
+    int recvlen;
+    int count;
+    int total=0;
+
+    fds.fd=mSockfd;
+    fds.events=POLLIN;
+    if (poll(&fds,1,timeout)<0) return -1;
+    if (!(fds.revents&POLLIN)) return 0;
+    while (1) {
+        clientlen=sizeof(clientaddr);
+        recvlen=recvfrom(mSockfd, mBuffer, XT_TRANSPORT_BUFSIZE, MSG_DONTWAIT, (struct sockaddr *) &clientaddr, &clientlen);
+        if (recvlen<=0) break;
+        mClientAddr=clientaddr;
+        mClientLen=clientlen;
+        mConnected=1;
+        ResetFraming();
+        Frame(mBuffer,recvlen,&count);
+        total+=count;
+    }
+    return total;
+}
+
+void XTouchUdpTransport::Send(unsigned char *buffer, unsigned int len) {
+    // Nothing can be sent to the X-Touch until it has been heard from
+    if (!mConnected) return;
+    sendto(mSockfd, buffer, len, 0, (struct sockaddr *) &mClientAddr, mClientLen);
+}
+
+int XTouchUdpTransport::Fd() {
+    return mSockfd;
+}
+
+// ----------------------------------------------------------------------------------------------
+// XTouchStreamTransport
+// ----------------------------------------------------------------------------------------------
+
+// infd and outfd may be the same, e.g. for a socket or pty
+XTouchStreamTransport::XTouchStreamTransport(int infd, int outfd) {
+    mInFd=infd;
+    mOutFd=outfd;
+    mLen=0;
+}
+
+XTouchStreamTransport::~XTouchStreamTransport() {
+    if (mInFd>2) close(mInFd);
+    if ((mOutFd>2)&&(mOutFd!=mInFd)) close(mOutFd);
+}
+
+// Waits up to timeout ms (-1 = forever) for data and passes on every complete message
+// Returns the number of messages, or -1 on error or end of stream
+int XTouchStreamTransport::Poll(int timeout) {
+    struct pollfd fds;
+    unsigned int used;
+    int readlen;
+    int count;
+
+    fds.fd=mInFd;
+    fds.events=POLLIN;
+    if (poll(&fds,1,timeout)<0) return -1;
+    if (!(fds.revents&(POLLIN|POLLHUP|POLLERR))) return 0;
+    readlen=read(mInFd, mBuffer+mLen, XT_TRANSPORT_BUFSIZE-mLen);
+    if (readlen<0) return ((errno==EAGAIN)||(errno==EINTR))?0:-1;
+    if (readlen==0) {
+        errno=0;
+        return -1;
+    }
+    mLen+=readlen;
+    used=Frame(mBuffer,mLen,&count);
+    if ((used==0)&&(mLen==XT_TRANSPORT_BUFSIZE)) {
+        // A SysEx message bigger than the buffer - throw it away
+        used=mLen;
+    }
+    memmove(mBuffer,mBuffer+used,mLen-used);
+    mLen-=used;
+    return count;
+}
+
+void XTouchStreamTransport::Send(unsigned char *buffer, unsigned int len) {
+    int written;
+    while (len>0) {
+        written=write(mOutFd, buffer, len);
+        if (written<0) {
+            if (errno==EINTR) continue;
+            perror("ERROR writing to stream");
+            return;
+        }
+        buffer+=written;
+        len-=written;
+    }
+}
+
+int XTouchStreamTransport::Fd() {
+    return mInFd;
+}
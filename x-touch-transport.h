@@ -0,0 +1,126 @@
+/* ----------------------------------------------------------------
+                   x-touch-xctl library - transports.
+   Carries Xctl messages between the XTouch class and the X-Touch,
+   either as UDP datagrams (the X-Touch's own network interface) or
+   as a byte stream over a pipe, pty or TCP connection, e.g. to a
+   MIDI bridge process.
+   ---------------------------------------------------------------- */
+
+/*
+MIT License
+
+Copyright (c) 2020 Martin Whitaker
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+/* Whatever the transport, received data is split into single MIDI messages
+   (expanding running status) before being passed on, so XTouch::HandlePacket()
+   always sees exactly one message at a time. With a trace, the messages from
+   one datagram or read share its trace ID and arrival time. The messages
+   passed on point into the transport's receive buffer and are only valid
+   during the callback.
+
+   Usage:
+     XTouchTransport *t=XTouchTransport::Open("udp:10111");
+     XTouch board(XTouchTransport::SendHandler,(void*)t);
+     t->RegisterReceiveCallback(handler,(void*)&board);
+     while (t->Poll(-1)>=0) { ... }
+
+   Transport specs for Open():
+     udp[:<port>]           Listen for the X-Touch on a UDP port (default 10111)
+     tcp:<host>:<port>      Connect to a TCP relay
+     file:<path>            Open a pty, fifo or character device for reading and writing
+     stdio                  Use stdin and stdout, e.g. when run from a MIDI bridge
+                            (stdout is then redirected to stderr for printing)
+*/
+
+#ifndef X_TOUCH_TRANSPORT_H
+#define X_TOUCH_TRANSPORT_H
+
+#include <netinet/in.h>
+#include "x-touch.h"
+
+#define XT_TRANSPORT_BUFSIZE 4096
+
+typedef void (*packet_receiver)(void *,unsigned char*, unsigned int); // User pointer, Message buffer pointer, Message length
+
+class XTouchTransport {
+    public:
+        XTouchTransport();
+        virtual ~XTouchTransport();
+
+        static XTouchTransport *Open(const char *spec);
+        static void SendHandler(void *transport, unsigned char *buffer, unsigned int len);
+
+        virtual int Poll(int timeout)=0;
+        virtual void Send(unsigned char *buffer, unsigned int len)=0;
+        virtual int Fd()=0;
+
+        void RegisterReceiveCallback(packet_receiver Handler, void *data);
+        void SetTrace(XTouchTrace *trace);
+
+    protected:
+        void ResetFraming();
+        unsigned int Frame(unsigned char *buffer, unsigned int len, int *count);
+
+        unsigned char mBuffer[XT_TRANSPORT_BUFSIZE];
+
+    private:
+        packet_receiver mReceiveCallbackHandler;
+        void *mReceiveCallbackData;
+        XTouchTrace *mTrace;
+        unsigned char mRunningStatus;
+        unsigned char mScratch[3];
+};
+
+// One datagram can hold several messages, but a message never spans datagrams
+class XTouchUdpTransport : public XTouchTransport {
+    public:
+        XTouchUdpTransport(int sockfd);
+        ~XTouchUdpTransport();
+
+        int Poll(int timeout);
+        void Send(unsigned char *buffer, unsigned int len);
+        int Fd();
+
+    private:
+        int mSockfd;
+        int mConnected;
+        socklen_t mClientLen;
+        struct sockaddr_in mClientAddr;
+};
+
+// Messages can be split across reads, so partial messages are kept until the rest arrives
+class XTouchStreamTransport : public XTouchTransport {
+    public:
+        XTouchStreamTransport(int infd, int outfd);
+        ~XTouchStreamTransport();
+
+        int Poll(int timeout);
+        void Send(unsigned char *buffer, unsigned int len);
+        int Fd();
+
+    private:
+        int mInFd;
+        int mOutFd;
+        unsigned int mLen;
+};
+
+#endif
@@ -36,6 +36,8 @@ SOFTWARE.
 */
 
 #include "x-touch.h"
+#include "x-touch-shm.h"
+#include "x-touch-trace.h"
 #include <stdio.h>
 #include <string.h>
 
@@ -62,6 +64,7 @@ XTouch::XTouch(packet_sender PacketSendHandler,void *data) {
     for(i=0;i<9;i++) {
         mFaderLevels[i]=0;
     }
+    memset(mSegmentCache,0,sizeof(mSegmentCache));
     memset(mScribblePads,0,sizeof(mScribblePads));
     for(i=0;i<8;i++) {
         mScribblePads[i].Colour=WHITE;
@@ -70,7 +73,15 @@ XTouch::XTouch(packet_sender PacketSendHandler,void *data) {
     mDialCallbackHandler=NULL;
     mLevelCallbackHandler=NULL;
     mFaderStateCallbackHandler=NULL;
+    mPublisher=NULL;
+    mTrace=NULL;
     mFullRefreshNeeded=0;
+    mBatchDepth=0;
+    mBatchPacking=0;
+    mMetersPending=0;
+    mSegmentsPending=0;
+    mBatchStatus=0;
+    mBatchLen=0;
 }
 
 XTouch::~XTouch() {
@@ -101,13 +112,43 @@ void XTouch::RegisterButtonCallback(callback Handler, void *data) {
     mButtonCallbackData=data;
 }
 
-// This moves a physical fader to the level provided (0 to 16384)
-// 12800 is the 0db mark
+// Resends the whole board on the next idle tick, for when updates may have been lost
+void XTouch::RequestRefresh() {
+    mFullRefreshNeeded=1;
+}
+
+// Pass this to XTouchScheduler::RegisterDropCallback, with the XTouch as the user pointer
+void XTouch::RefreshHandler(void *xtouch, unsigned char id, int value) {
+    ((XTouch *)xtouch)->RequestRefresh();
+}
+
+// The state of the surface is kept up to date in the shared memory block of the publisher given here
+// (see x-touch-shm.h). NULL stops publishing
+void XTouch::SetPublisher(XTouchShmPublisher *publisher) {
+    int i;
+    mPublisher=publisher;
+    if (!mPublisher) return;
+    mPublisher->BeginUpdate();
+    for(i=0;i<9;i++) mPublisher->SetFader(i,mFaderLevels[i]);
+    for(i=0;i<8;i++) mPublisher->SetMeter(i,mMeterLevels[i]);
+    for(i=0;i<116;i++) mPublisher->SetLight(i,mButtonLEDStates[i]);
+    mPublisher->EndUpdate();
+}
+
+// Packets received and sent are traced here (see x-touch-trace.h). NULL stops tracing
+void XTouch::SetTrace(XTouchTrace *trace) {
+    mTrace=trace;
+}
+
+// This moves a physical fader to the level provided (0 to 16383)
+// 12800 is the 0db mark (see x-touch-fader.h for converting to and from dB)
 // channel is in the range 0 to 8 (8=the 'main' fader)
 void XTouch::SetFaderLevel(int channel, int level)
 {
-    if ((channel<0)||(channel>8)||(level<0)||(level>40960)) return;
+    if ((channel<0)||(channel>8)||(level<0)) return;
+    if (level>16383) level=16383;
     mFaderLevels[channel]=level;
+    if (mPublisher) mPublisher->SetFader(channel,level);
     SendSingleFader(channel);
 }
 
@@ -116,8 +157,9 @@ void XTouch::SetFaderLevel(int channel, int level)
 // level = 0 to 9
 void XTouch::SetMeterLevel(int channel, int level)
 {
-    if ((channel<0)||(channel>8)||(level<0)||(level>9)) return;
+    if ((channel<0)||(channel>7)||(level<0)||(level>9)) return;
     mMeterLevels[channel]=level;
+    if (mPublisher) mPublisher->SetMeter(channel,level);
     SendAllMeters();
 }
 
@@ -126,6 +168,10 @@ void XTouch::SendAllMeters()
 {
     int i;
     unsigned char sendbuf[9];
+    if (mBatchDepth>0) {
+        mMetersPending=1;
+        return;
+    }
     sendbuf[0]=0xd0;
     for(i=0;i<8;i++) {
         sendbuf[1+i]=(i<<4)+mMeterLevels[i];
@@ -138,7 +184,7 @@ void XTouch::SendAllMeters()
 // position = -6 for left pan, to +6 for right pan
 void XTouch::SetDialPan(int channel, int position)
 {
-    if ((position<-6)||(position>6)) return;
+    if ((channel<0)||(channel>7)||(position<-6)||(position>6)) return;
     mDialLeds[channel]=1<<(position+6);
     SendSingleDial(channel);
 }
@@ -150,7 +196,7 @@ void XTouch::SetDialLevel(int channel, int level)
 {
     int i;
     int v=0;
-    if ((level<0)||(level>13)) return;
+    if ((channel<0)||(channel>7)||(level<0)||(level>13)) return;
     for(i=0;i<level;i++) {
         v+=1<<i;
     }
@@ -158,6 +204,16 @@ void XTouch::SetDialLevel(int channel, int level)
     SendSingleDial(channel);
 }
 
+// Lights any combination of the LEDs around the dial
+// Channel = 0 to 7
+// leds = bit per LED, bit 0 = bottom left to bit 12 = bottom right
+void XTouch::SetDialLeds(int channel, unsigned int leds)
+{
+    if ((channel<0)||(channel>7)) return;
+    mDialLeds[channel]=leds&0x3fff;
+    SendSingleDial(channel);
+}
+
 // Displays the integer provided in the 'assignment' display
 // range = -9 to 99
 void XTouch::SetAssignment(int v) {
@@ -192,6 +248,19 @@ void XTouch::SetTime(struct tm* t) {
     SendSegments();
 }
 
+// Displays text across the 7-segment displays, starting at digit 'start'
+// 0 to 1 - Assignment, 2 to 4 - Bars/Hours, 5 to 6 - Beats/Minutes,
+// 7 to 8 - Sub division/Seconds, 9 to 11 - Ticks/Frames
+// Letters are approximated as best the 7 segments allow
+void XTouch::SetSegmentText(int start, const char *text) {
+    int i;
+    if ((start<0)||(start>11)||(!text)) return;
+    for(i=start;(i<12)&&(*text);i++,text++) {
+        SetSegments(i,SegmentBitmap(*text));
+    }
+    SendSegments();
+}
+
 // Sets the state of a button light (OFF, FLASHING, ON)
 // 0 to 7 - Rec buttons
 // 8 to 15 - Solo buttons
@@ -217,15 +286,56 @@ void XTouch::SetTime(struct tm* t) {
 void XTouch::SetSingleButton(unsigned char n, xt_button_state_t v) {
     if ((n>115)||(v>2)) return;
     mButtonLEDStates[n]=v;
+    if (mPublisher) mPublisher->SetLight(n,v);
     SendSingleButton(n);
 }
 
+// Only sent if the 7+7 characters, colour or inversion have changed
+// Text is read up to the first null, so anything after it doesn't count as a change
 void XTouch::SetScribble(int channel, xt_ScribblePad_t info) {
+    xt_ScribblePad_t *pad;
+    int i;
     if ((channel<0)||(channel>7)) return;
-    mScribblePads[channel]=info;
+    for(i=0;i<8;i++) {
+        if ((i==7)||((i>0)&&(info.TopText[i-1]==0))) info.TopText[i]=0;
+        if ((i==7)||((i>0)&&(info.BotText[i-1]==0))) info.BotText[i]=0;
+    }
+    info.Inverted=info.Inverted?1:0;
+    pad=&mScribblePads[channel];
+    if ((memcmp(pad->TopText,info.TopText,8)==0)&&(memcmp(pad->BotText,info.BotText,8)==0)&&
+        (pad->Colour==info.Colour)&&(pad->Inverted==info.Inverted)) return;
+    *pad=info;
     SendScribble(channel);
 }
 
+// Collects everything sent until the matching EndBatch() into as few packets as possible
+// Consecutive messages are packed together using running status, and the meter and
+// 7-segment dumps are only sent once however many times they are changed in the batch
+// Batches can be nested - nothing is sent until the outermost EndBatch()
+// and changes made in a batch are published to shared memory as one state
+void XTouch::BeginBatch() {
+    if (mPublisher) mPublisher->BeginUpdate();
+    mBatchDepth++;
+    mBatchPacking=1;
+}
+
+void XTouch::EndBatch() {
+    if (mBatchDepth==0) return;
+    if (mPublisher) mPublisher->EndUpdate();
+    mBatchDepth--;
+    if (mBatchDepth>0) return;
+    if (mMetersPending) {
+        mMetersPending=0;
+        SendAllMeters();
+    }
+    if (mSegmentsPending) {
+        mSegmentsPending=0;
+        SendSegments();
+    }
+    FlushBatch();
+    mBatchPacking=0;
+}
+
 // ----------------------------------------------------------------------------------------------
 // Private functions
 // ----------------------------------------------------------------------------------------------
@@ -290,7 +400,31 @@ unsigned char XTouch::SegmentBitmap(char v) {
         case '9': return 0x6f;
         case '0': return 0x3f;
         case '-': return 0x40;
-        case 'a': return 0x77;
+        case '_': return 0x08;
+        case 'a': case 'A': return 0x77;
+        case 'b': case 'B': return 0x7c;
+        case 'c': return 0x58;
+        case 'C': return 0x39;
+        case 'd': case 'D': return 0x5e;
+        case 'e': case 'E': return 0x79;
+        case 'f': case 'F': return 0x71;
+        case 'g': case 'G': return 0x3d;
+        case 'h': return 0x74;
+        case 'H': return 0x76;
+        case 'i': case 'I': return 0x30;
+        case 'j': case 'J': return 0x1e;
+        case 'l': case 'L': return 0x38;
+        case 'n': case 'N': return 0x54;
+        case 'o': return 0x5c;
+        case 'O': return 0x3f;
+        case 'p': case 'P': return 0x73;
+        case 'q': case 'Q': return 0x67;
+        case 'r': case 'R': return 0x50;
+        case 's': case 'S': return 0x6d;
+        case 't': case 'T': return 0x78;
+        case 'u': return 0x1c;
+        case 'U': return 0x3e;
+        case 'y': case 'Y': return 0x6e;
 
         default: return 0;
     }
@@ -312,6 +446,10 @@ void XTouch::SendSegments() {
     unsigned char sendbuf[25];
     unsigned char segment;
 
+    if (mBatchDepth>0) {
+        mSegmentsPending=1;
+        return;
+    }
     sendbuf[0]=0xb0;
     for(segment=0;segment<12;segment++) {
         sendbuf[1+segment*2]=segment+0x60;
@@ -411,13 +549,64 @@ void XTouch::SendAllBoard() {
 
 void XTouch::SendPacket(unsigned char *buffer, unsigned int len)
 {
-    mPacketSendHandler(mPPacketData, buffer,len);
+    int i;
+    if (!mBatchPacking) {
+        Emit(buffer,len);
+        return;
+    }
+    // SysEx messages (scribble pads, idle, probe response) always go in a packet of their own
+    if ((len==0)||(buffer[0]>=0xf0)) {
+        FlushBatch();
+        Emit(buffer,len);
+        return;
+    }
+    if (mBatchLen+len>XT_BATCH_SIZE) FlushBatch();
+    if (len>XT_BATCH_SIZE) {
+        Emit(buffer,len);
+        return;
+    }
+    // Drop the status byte if it is the same as the last one in the batch (running status)
+    if ((mBatchLen>0)&&(buffer[0]==mBatchStatus)) {
+        memcpy(mBatchBuffer+mBatchLen,buffer+1,len-1);
+        mBatchLen+=len-1;
+    } else {
+        memcpy(mBatchBuffer+mBatchLen,buffer,len);
+        mBatchLen+=len;
+    }
+    for(i=len-1;i>=0;i--) {
+        if (buffer[i]&0x80) {
+            mBatchStatus=buffer[i];
+            break;
+        }
+    }
+}
+
+// Every packet leaves through here
+void XTouch::Emit(unsigned char *buffer, unsigned int len)
+{
+    int64_t start;
+    if (!mTrace) {
+        mPacketSendHandler(mPPacketData,buffer,len);
+        return;
+    }
+    start=XTouchTrace::Now();
+    mPacketSendHandler(mPPacketData,buffer,len);
+    mTrace->Sent(XT_TRACE_OUTPUT,"SendPacket",mTrace->Current(),start,0,buffer,len);
+}
+
+void XTouch::FlushBatch()
+{
+    if (mBatchLen==0) return;
+    Emit(mBatchBuffer,mBatchLen);
+    mBatchLen=0;
+    mBatchStatus=0;
 }
 
 int XTouch::HandleFaderTouch(unsigned char *buffer, unsigned int len) {
     int fader;
     if ((len==3)&&(buffer[0]==0x90)&&(buffer[1]>=0x68)&&(buffer[1]<=0x70)) {
         fader=buffer[1]-0x68;
+        if (mPublisher) mPublisher->SetTouched(fader,(buffer[2]!=0));
         if (mFaderStateCallbackHandler) mFaderStateCallbackHandler(mFaderStateCallbackData,fader,(buffer[2]!=0));
         return 1;
     }
@@ -430,6 +619,7 @@ int XTouch::HandleLevel(unsigned char *buffer, unsigned int len) {
     if ((len==3)&&((buffer[0]&0xf0)==0xe0)) {
         channel=buffer[0]&0x0f;
         level=buffer[1]+(buffer[2]<<7);
+        if (mPublisher) mPublisher->SetFader(channel,level);
         if (mLevelCallbackHandler) mLevelCallbackHandler(mLevelCallbackData, channel, level);
         return 1;
     }
@@ -452,6 +642,7 @@ int XTouch::HandleRotation(unsigned char *buffer, unsigned int len) {
 
 int XTouch::HandleButton(unsigned char *buffer, unsigned int len) {
     if ((len==3)&&(buffer[0]==0x90)) {
+        if (mPublisher) mPublisher->SetPressed(buffer[1],(buffer[2]!=0));
         if (mButtonCallbackHandler) mButtonCallbackHandler(mButtonCallbackData, buffer[1], (buffer[2]!=0));
         return 1;
     }
@@ -482,6 +673,18 @@ int XTouch::HandleUnknown(unsigned char *buffer, unsigned int len) {
 }
 
 int XTouch::HandlePacket(unsigned char *buffer, unsigned int len) {
+    int handled;
+    uint32_t id=0;
+    if (mTrace) id=mTrace->Receive();
+    // What the packet changes and whatever the callbacks set in response are published together
+    if (mPublisher) mPublisher->BeginUpdate();
+    handled=HandleMessage(buffer,len);
+    if (mPublisher) mPublisher->EndUpdate();
+    if (mTrace) mTrace->Received(id,buffer,len);
+    return handled;
+}
+
+int XTouch::HandleMessage(unsigned char *buffer, unsigned int len) {
     CheckIdle();
     if (HandleProbe(buffer,len)>0) return 1;
     if (HandleFaderTouch(buffer,len)>0) return 1;
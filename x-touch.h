@@ -35,8 +35,16 @@ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
 SOFTWARE.
 */
 
+#ifndef X_TOUCH_H
+#define X_TOUCH_H
+
 #include <time.h>
 
+#define XT_BATCH_SIZE 1400
+
+class XTouchShmPublisher;
+class XTouchTrace;
+
 typedef void (*packet_sender)(void *,unsigned char*, unsigned int); // User pointer, Packet buffer pointer, Packet length
 typedef void (*callback)(void *,unsigned char, int); // User pointer, Object ID, New value
 
@@ -62,18 +70,27 @@ class XTouch {
         void SetTime(struct tm* t);
         void SetDialPan(int channel, int position);
         void SetDialLevel(int channel, int level);
+        void SetDialLeds(int channel, unsigned int leds);
         void SetFaderLevel(int channel, int level);
         void SetMeterLevel(int channel, int level);
         void SendAllMeters();
         void SetSingleButton(unsigned char n, xt_button_state_t v);
         void SetScribble(int channel, xt_ScribblePad_t info);
+        void SetSegmentText(int start, const char *text);
+        void BeginBatch();
+        void EndBatch();
 
         void RegisterFaderCallback(callback Handler, void *data);
         void RegisterFaderStateCallback(callback Handler, void *data);
         void RegisterDialCallback(callback Handler, void *data);
         void RegisterButtonCallback(callback Handler, void *data);      
+        void SetPublisher(XTouchShmPublisher *publisher);
+        void SetTrace(XTouchTrace *trace);
+        void RequestRefresh();
+        static void RefreshHandler(void *xtouch, unsigned char id, int value);
 
     private:
+        int HandleMessage(unsigned char *buffer, unsigned int len);
         int HandleFaderTouch(unsigned char *buffer, unsigned int len);
         int HandleLevel(unsigned char *buffer, unsigned int len);
         int HandleRotation(unsigned char *buffer, unsigned int len);
@@ -81,6 +98,8 @@ class XTouch {
         int HandleProbe(unsigned char *buffer, unsigned int len);
         int HandleUnknown(unsigned char *buffer, unsigned int len);
         void SendPacket(unsigned char *buffer, unsigned int len);
+        void Emit(unsigned char *buffer, unsigned int len);
+        void FlushBatch();
         void CheckIdle();
         void SendScribble(unsigned char n);
         void SendAllScribble();
@@ -108,6 +127,9 @@ class XTouch {
         void *mLevelCallbackData;
         void *mFaderStateCallbackData;
 
+        XTouchShmPublisher *mPublisher;
+        XTouchTrace *mTrace;
+
         time_t mLastIdle;
         int mFullRefreshNeeded;
         xt_button_state_t mButtonLEDStates[127];
@@ -117,4 +139,14 @@ class XTouch {
         unsigned char mSegmentCache[12];
 
         xt_ScribblePad_t mScribblePads[8];
+
+        int mBatchDepth;
+        int mBatchPacking;
+        int mMetersPending;
+        int mSegmentsPending;
+        unsigned char mBatchStatus;
+        unsigned int mBatchLen;
+        unsigned char mBatchBuffer[XT_BATCH_SIZE];
 };
+
+#endif